@@ -104,6 +104,7 @@ public:
         std::reverse(txid.v.begin(), txid.v.end());
 
         request.set_txid(txid.decompress());
+        request.set_topological(true);
 
         graphsearch::GraphSearchReply reply;
 
@@ -131,8 +132,7 @@ public:
                 txs.push_back(tx);
             }
 
-            txs = gs::util::topological_sort(txs);
-
+            // reply is already in topological order
             for (auto & n : txs) {
                 validator.add_tx(n, false);
             }
@@ -361,7 +361,20 @@ public:
             << "last_incoming_zmq_blk_unix: " << reply.last_incoming_zmq_blk_unix() << "\n"
             << "last_outgoing_zmq_blk_unix: " << reply.last_outgoing_zmq_blk_unix() << "\n"
             << "last_incoming_zmq_blk_size: " << reply.last_incoming_zmq_blk_size() << "\n"
-            << "last_outgoing_zmq_blk_size: " << reply.last_outgoing_zmq_blk_size() << "\n";
+            << "last_outgoing_zmq_blk_size: " << reply.last_outgoing_zmq_blk_size() << "\n"
+            << "validations:                " << reply.validation_nanoseconds().count() << "\n"
+            << "validation_nanoseconds_max: " << reply.validation_nanoseconds().max()   << "\n"
+            << "validation_inputs_max:      " << reply.validation_inputs().max()        << "\n"
+            << "validation_lookups_max:     " << reply.validation_lookups().max()       << "\n";
+
+        for (auto & slow : reply.slowest_validations()) {
+            std::cout
+                << "slow_validation:            " << slow.txid()
+                << " token " << slow.tokenid()
+                << " " << slow.nanoseconds() << " ns"
+                << " " << slow.inputs() << " inputs"
+                << " " << slow.lookups() << " lookups\n";
+        }
 
         return true;
     }
@@ -0,0 +1,97 @@
+#ifndef GS_ANCESTOR_SKETCH_HPP
+#define GS_ANCESTOR_SKETCH_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <gs++/bhash.hpp>
+
+namespace gs {
+
+// approximate size of the ancestor set of a node (itself included)
+//
+// a hyperloglog over txids, the sketch of a node is its own txid merged with
+// the sketches of its inputs so overlapping ancestry is only counted once
+// count is typically within 20%, small sets come out close to exact
+//
+// bytes are estimated as count times the mean txdata size of the ancestors,
+// the mean weighs each input by its count so shared ancestry is counted more
+// than once there, which skews the mean a lot less than it would a sum
+struct ancestor_sketch
+{
+    constexpr static unsigned register_bits = 5;
+    constexpr static unsigned num_registers = 1 << register_bits;
+
+    std::array<std::uint8_t, num_registers> registers;
+    float                                   mean_size;
+
+    ancestor_sketch()
+    : mean_size(0)
+    {
+        registers.fill(0);
+    }
+
+    void insert(const gs::txid& txid)
+    {
+        // txids are hashes already but test data and the like are not, so mix anyway
+        std::uint64_t h = 0;
+        for (unsigned i=0; i<8; ++i) {
+            h |= static_cast<std::uint64_t>(txid.v[i]) << (i*8);
+        }
+        for (unsigned i=8; i<16; ++i) {
+            h ^= static_cast<std::uint64_t>(txid.v[i]) << ((i-8)*8 + 3);
+        }
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        h =  h ^ (h >> 31);
+
+        const unsigned idx = h & (num_registers - 1);
+        std::uint64_t w = h >> register_bits;
+
+        std::uint8_t rank = 1;
+        while (rank <= 64 - register_bits && ! (w & 1)) {
+            w >>= 1;
+            ++rank;
+        }
+
+        if (rank > registers[idx]) {
+            registers[idx] = rank;
+        }
+    }
+
+    void merge(const ancestor_sketch& other)
+    {
+        for (unsigned i=0; i<num_registers; ++i) {
+            if (other.registers[i] > registers[i]) {
+                registers[i] = other.registers[i];
+            }
+        }
+    }
+
+    double count() const
+    {
+        double sum = 0;
+        unsigned zeros = 0;
+        for (const std::uint8_t r : registers) {
+            sum += std::ldexp(1.0, -static_cast<int>(r));
+            zeros += r == 0;
+        }
+
+        const double m = num_registers;
+        const double estimate = 0.697 * m * m / sum;
+
+        // linear counting is far better while registers are still empty
+        if (estimate <= 2.5 * m && zeros > 0) {
+            return m * std::log(m / zeros);
+        }
+
+        return estimate;
+    }
+
+    double bytes() const
+    { return count() * mean_size; }
+};
+
+}
+
+#endif
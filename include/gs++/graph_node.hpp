@@ -1,23 +1,13 @@
 #ifndef GS_GRAPH_NODE_HPP
 #define GS_GRAPH_NODE_HPP
 
-#include <vector>
 #include <cstdint>
-#include <gs++/bhash.hpp>
 
 namespace gs {
 
-struct graph_node
-{
-    std::vector<graph_node*>  inputs;
-    std::vector<std::uint8_t> txdata;
-
-    graph_node () {}
-
-    graph_node (const std::vector<std::uint8_t>& txdata)
-    : txdata(txdata)
-    {}
-};
+// dense index of a transaction inside of its token_details
+// ids are assigned in insertion order starting from 0
+using graph_node_id = std::uint32_t;
 
 }
 
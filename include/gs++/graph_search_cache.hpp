@@ -0,0 +1,109 @@
+#ifndef GS_GRAPH_SEARCH_CACHE_HPP
+#define GS_GRAPH_SEARCH_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <absl/container/flat_hash_map.h>
+#include <gs++/bhash.hpp>
+
+namespace gs {
+
+// graph search replies for recently requested txids
+//
+// replies are tagged with the confirmed graph epoch, so anything which removes
+// confirmed nodes (a reorg or a reload) drops them, while blocks which only
+// add nodes leave the ancestors of existing ones and so the replies alone.
+// replies which include mempool transactions are also tagged with the
+// mempool graph generation and dropped once it moves on
+//
+// only the txdata of a reply is kept, a hit copies it into the reply
+// without parsing anything
+//
+// least recently used entries are evicted once max_bytes is exceeded
+struct graph_search_cache
+{
+    // mempool generation passed for replies which do not depend on the mempool graph
+    constexpr static std::uint64_t no_mempool { 0 };
+
+    using reply_txdata = std::vector<std::string>;
+
+    struct key
+    {
+        gs::txid      txid;
+        std::uint64_t fingerprint; // of the exclusion set
+
+        key(const gs::txid& txid, const std::uint64_t fingerprint)
+        : txid(txid)
+        , fingerprint(fingerprint)
+        {}
+
+        bool operator==(const key& o) const
+        { return txid == o.txid && fingerprint == o.fingerprint; }
+
+        template <typename H>
+        friend H AbslHashValue(H h, const key& m)
+        {
+            return H::combine(std::move(h), m.txid, m.fingerprint);
+        }
+    };
+
+    struct entry
+    {
+        std::vector<gs::txid>               exclude_txids; // sorted, guards against fingerprint collisions
+        std::shared_ptr<const reply_txdata> reply;
+        std::size_t                         bytes;
+        std::uint64_t                       confirmed_epoch;
+        std::uint64_t                       mempool_generation;
+        std::list<key>::iterator            lru_it;
+    };
+
+    std::size_t max_bytes;
+    std::size_t bytes;
+
+    absl::flat_hash_map<key, entry> entries;
+    std::list<key>                  lru; // front is most recently used
+    std::mutex                      mtx;
+
+    graph_search_cache(const std::size_t max_bytes = 0)
+    : max_bytes(max_bytes)
+    , bytes(0)
+    {}
+
+    // sorts exclude_txids in place
+    static std::uint64_t fingerprint(std::vector<gs::txid>& exclude_txids);
+
+    // confirmed_epoch and mempool_generation are the current ones of the graphs
+    // reply is shared with the cache so it can be copied out after the lock is dropped
+    bool get(
+        const gs::txid& txid,
+        const std::vector<gs::txid>& exclude_txids,
+        const std::uint64_t confirmed_epoch,
+        const std::uint64_t mempool_generation,
+        std::shared_ptr<const reply_txdata>& reply
+    );
+
+    // confirmed_epoch and mempool_generation are the ones seen before the search,
+    // mempool_generation is no_mempool if the reply does not include mempool transactions
+    void put(
+        const gs::txid& txid,
+        const std::vector<gs::txid>& exclude_txids,
+        const std::uint64_t confirmed_epoch,
+        const std::uint64_t mempool_generation,
+        reply_txdata&& reply
+    );
+
+    void clear();
+
+    std::size_t size();
+
+private:
+    void erase(const absl::flat_hash_map<key, entry>::iterator it);
+};
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef GS_SLP_RECORD_HPP
+#define GS_SLP_RECORD_HPP
+
+#include <vector>
+#include <cstdint>
+#include <absl/types/variant.h>
+#include <gs++/bhash.hpp>
+#include <gs++/output.hpp>
+#include <gs++/slp_transaction.hpp>
+#include <gs++/transaction.hpp>
+
+namespace gs {
+
+// the parts of a transaction slp validation looks at
+//
+// scripts, genesis metadata and serialized bytes are left out, the validator
+// keeps the bytes in its tx_store and parses them again when they are needed
+struct slp_record
+{
+    gs::tokenid                tokenid;
+    std::vector<gs::outpoint>  inputs;
+    std::vector<std::uint64_t> amounts;         // slp amount of vout i+1, qty for genesis and mint
+    std::uint32_t              num_outputs;
+    std::uint32_t              mint_baton_vout; // 0 if there is none
+    std::uint16_t              token_type;
+    gs::slp_transaction_type   type;
+
+    slp_record()
+    : num_outputs(0)
+    , mint_baton_vout(0)
+    , token_type(0)
+    , type(gs::slp_transaction_type::invalid)
+    {}
+
+    explicit slp_record(const gs::transaction& tx)
+    : tokenid(tx.slp.tokenid)
+    , inputs(tx.inputs)
+    , num_outputs(tx.outputs.size())
+    , mint_baton_vout(tx.mint_baton_outpoint().vout)
+    , token_type(tx.slp.token_type)
+    , type(tx.slp.type)
+    {
+        switch (type) {
+            case gs::slp_transaction_type::send:
+                amounts = absl::get<gs::slp_transaction_send>(tx.slp.slp_tx).amounts;
+                break;
+            case gs::slp_transaction_type::mint:
+                amounts = { absl::get<gs::slp_transaction_mint>(tx.slp.slp_tx).qty };
+                break;
+            case gs::slp_transaction_type::genesis:
+                amounts = { absl::get<gs::slp_transaction_genesis>(tx.slp.slp_tx).qty };
+                break;
+            default:
+                break;
+        }
+    }
+
+    // same as transaction::output_slp_amount
+    std::uint64_t output_slp_amount(const std::uint64_t vout) const
+    {
+        if (vout == 0 || vout-1 >= amounts.size()) {
+            return 0;
+        }
+
+        return amounts[vout-1];
+    }
+
+    // same as checking transaction::slp_outputs() for vout without copying them
+    bool is_slp_output(const std::uint32_t vout) const
+    {
+        if (vout == 0 || vout >= num_outputs) {
+            return false;
+        }
+
+        switch (type) {
+            case gs::slp_transaction_type::send:    return vout <= amounts.size();
+            case gs::slp_transaction_type::mint:
+            case gs::slp_transaction_type::genesis: return vout == 1 || vout == mint_baton_vout;
+            default:                                return false;
+        }
+    }
+};
+
+}
+
+#endif
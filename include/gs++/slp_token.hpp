@@ -10,6 +10,7 @@
 #include <gs++/bhash.hpp>
 #include <gs++/output.hpp>
 #include <gs++/transaction.hpp>
+#include <gs++/tx_store.hpp>
 #include <gs++/slp_transaction.hpp>
 
 
@@ -19,7 +20,7 @@ struct slp_token
 {
     gs::tokenid tokenid;
 
-    absl::flat_hash_map<gs::txid, gs::transaction> transactions;
+    absl::flat_hash_map<gs::txid, gs::tx_handle> transactions; // bytes are in the slpdb's store
     absl::flat_hash_map<gs::outpoint, gs::slp_output> utxos;
     absl::optional<gs::outpoint> mint_baton_outpoint;
     
@@ -28,7 +29,6 @@ struct slp_token
 
     slp_token(const gs::transaction& tx)
     : tokenid(gs::tokenid(tx.txid.v))
-    , transactions({{ tx.txid, tx }})
     {
         assert(tx.slp.type == gs::slp_transaction_type::genesis);
     }
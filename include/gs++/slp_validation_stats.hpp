@@ -0,0 +1,143 @@
+#ifndef GS_SLP_VALIDATION_STATS_HPP
+#define GS_SLP_VALIDATION_STATS_HPP
+
+#include <array>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include <gs++/bhash.hpp>
+
+namespace gs {
+
+// what one top level validation did
+struct slp_validation_cost
+{
+    std::uint32_t inputs;      // input outpoints examined
+    std::uint32_t lookups;     // probes of records, valid and mint_batons
+    std::uint64_t nanoseconds;
+
+    slp_validation_cost()
+    : inputs(0)
+    , lookups(0)
+    , nanoseconds(0)
+    {}
+};
+
+// bucket 0 counts zeros, bucket i counts values in [2^(i-1), 2^i)
+struct slp_validation_histogram
+{
+    constexpr static unsigned num_buckets = 64;
+
+    std::array<std::uint64_t, num_buckets> buckets;
+    std::uint64_t count;
+    std::uint64_t sum;
+    std::uint64_t max;
+
+    slp_validation_histogram()
+    : count(0)
+    , sum(0)
+    , max(0)
+    {
+        buckets.fill(0);
+    }
+
+    void add(const std::uint64_t v)
+    {
+        unsigned bucket = 0;
+        for (std::uint64_t n = v; n != 0 && bucket < num_buckets - 1; n >>= 1) {
+            ++bucket;
+        }
+
+        ++buckets[bucket];
+        ++count;
+        sum += v;
+        max = std::max(max, v);
+    }
+};
+
+struct slp_slow_validation
+{
+    gs::txid            txid;
+    gs::tokenid         tokenid;
+    slp_validation_cost cost;
+};
+
+struct slp_validation_report
+{
+    slp_validation_histogram         nanoseconds;
+    slp_validation_histogram         inputs;
+    slp_validation_histogram         lookups;
+    std::vector<slp_slow_validation> slowest; // slowest first
+};
+
+// costs of every top level validation since startup, and the slowest recent ones
+//
+// slowest is kept over two windows of slowest_window validations each, so a
+// transaction drops out somewhere between one and two windows after it was seen
+class slp_validation_stats
+{
+public:
+    constexpr static std::size_t   num_slowest    = 16;
+    constexpr static std::uint64_t slowest_window = 1 << 16;
+
+    slp_validation_stats()
+    : window_count(0)
+    {}
+
+    void record(const gs::txid& txid, const gs::tokenid& tokenid, const slp_validation_cost& cost)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        current.nanoseconds.add(cost.nanoseconds);
+        current.inputs.add(cost.inputs);
+        current.lookups.add(cost.lookups);
+
+        if (++window_count == slowest_window) {
+            previous_slowest.swap(current.slowest);
+            current.slowest.clear();
+            window_count = 0;
+        }
+
+        std::vector<slp_slow_validation>& slowest = current.slowest;
+        if (slowest.size() == num_slowest && cost.nanoseconds <= slowest.back().cost.nanoseconds) {
+            return;
+        }
+
+        slp_slow_validation entry;
+        entry.txid = txid;
+        entry.tokenid = tokenid;
+        entry.cost = cost;
+        slowest.insert(std::upper_bound(slowest.begin(), slowest.end(), entry, slower), entry);
+        if (slowest.size() > num_slowest) {
+            slowest.pop_back();
+        }
+    }
+
+    slp_validation_report report() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        slp_validation_report ret = current;
+        ret.slowest.insert(ret.slowest.end(), previous_slowest.begin(), previous_slowest.end());
+        std::sort(ret.slowest.begin(), ret.slowest.end(), slower);
+        if (ret.slowest.size() > num_slowest) {
+            ret.slowest.resize(num_slowest);
+        }
+
+        return ret;
+    }
+
+private:
+    static bool slower(const slp_slow_validation& a, const slp_slow_validation& b)
+    { return a.cost.nanoseconds > b.cost.nanoseconds; }
+
+    mutable std::mutex               mtx;
+    slp_validation_report            current;
+    std::vector<slp_slow_validation> previous_slowest;
+    std::uint64_t                    window_count;
+};
+
+}
+
+#endif
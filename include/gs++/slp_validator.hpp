@@ -8,39 +8,129 @@
 #include <absl/numeric/int128.h>
 
 #include <gs++/transaction.hpp>
+#include <gs++/slp_record.hpp>
+#include <gs++/slp_validation_stats.hpp>
 #include <gs++/bhash.hpp>
+#include <gs++/tx_store.hpp>
 
 
 namespace gs {
 
+// why validate(txid) last rejected a transaction
+enum class slp_invalid_reason
+{
+    send_inputs,   // outputs exceed the amount of valid inputs of the token
+    mint_baton,    // no valid mint baton leading back to genesis
+    genesis_input, // nft1 child genesis without a valid group input
+};
+
 struct slp_validator
 {
-    absl::flat_hash_map<gs::txid, gs::transaction> transaction_map;
+    // serialized bytes live in store, records only keep what validation reads
+    gs::tx_store& store;
+    absl::flat_hash_map<gs::txid, gs::slp_record> records;
     absl::flat_hash_set<gs::txid> valid;
 
-    slp_validator() = default;
+    // transactions validate(txid) rejected, so asking again is a lookup
+    // an entry is dropped once one of its inputs becomes valid, as are the
+    // entries of everything spending it, since the outcome may then change
+    // only inputs which are in records are indexed, transactions arrive in
+    // topological order so an input missing on rejection (bch funding) stays missing
+    absl::flat_hash_map<gs::txid, slp_invalid_reason> invalid;
+    absl::flat_hash_map<gs::txid, std::vector<gs::txid>> invalid_spenders; // input txid -> entries of invalid
+
+    struct mint_baton
+    {
+        gs::tokenid   tokenid;
+        std::uint16_t token_type;
+    };
+
+    // baton outputs of valid genesis and mint transactions, a mint is valid
+    // if it spends one of its own token, spent batons are kept as they can
+    // not be spent again by anything which validates
+    absl::flat_hash_map<gs::outpoint, mint_baton> mint_batons;
+
+    // cost of every validation done through validate or add_txs
+    slp_validation_stats stats;
+
+    // results of a token being validated on its own, seen by the checks on top of
+    // valid and mint_batons so nothing shared is written until they are merged
+    struct overlay
+    {
+        absl::flat_hash_set<gs::txid>                 valid;
+        absl::flat_hash_map<gs::outpoint, mint_baton> mint_batons;
+    };
+
+    // add_txs validates batches with fewer tokens than this on the calling
+    // thread, as starting workers for them costs more than it saves
+    std::size_t min_parallel_partitions;
+
+    slp_validator(gs::tx_store& store = gs::tx_store::shared())
+    : store(store)
+    , min_parallel_partitions(8)
+    {}
+
+    ~slp_validator();
+
+    slp_validator(const slp_validator&) = delete;
+    slp_validator& operator=(const slp_validator&) = delete;
 
     bool add_tx(const gs::transaction& tx, const bool trusted);
+
+    // same as calling add_tx on each of txs in order, which must be topological
+    // tokens never depend on each other, apart from nft1 child genesis, so each
+    // token is validated on its own by up to threads workers and the results are
+    // merged in order of txs, returns what add_tx would have for each of txs
+    std::vector<bool> add_txs(
+        const std::vector<const gs::transaction*>& txs,
+        const bool trusted,
+        const unsigned threads
+    );
+
     bool remove_tx(const gs::txid& txid);
+    // removes every transaction, leaving the validator as it was constructed
+    void clear();
     bool add_valid_txid(const gs::txid& txid);
     bool has(const gs::txid& txid) const;
     bool has_valid(const gs::txid& txid) const;
-    gs::transaction get(const gs::txid& txid) const;
+    bool has_invalid(const gs::txid& txid) const;
+    // parses the stored bytes of txid, false if it is unknown or they do not parse
+    bool get(const gs::txid& txid, gs::transaction& tx) const;
 
-    bool check_outputs_valid(
-        absl::flat_hash_set<gs::txid> & seen,
-        const gs::transaction & tx
-    );
+    // record of txid, stays valid until txid is removed or another transaction is added
+    // nullptr if unknown
+    const gs::slp_record* find(const gs::txid& txid) const;
 
-    bool check_send(
-        absl::flat_hash_set<gs::txid> & seen,
-        const gs::transaction & tx
-    );
-    bool check_mint(const gs::transaction & tx);
-    bool check_genesis(const gs::transaction & tx);
+    // serialized bytes of txid borrowed from store, they stay valid for the life of the store
+    bool txdata(const gs::txid& txid, const std::uint8_t*& data, std::size_t& size) const;
+
+    // these only read the validator, pending is consulted as well when given
+    bool check_send(const gs::slp_record & record, const overlay* pending, slp_validation_cost & cost) const;
+    bool check_mint(const gs::slp_record & record, const overlay* pending, slp_validation_cost & cost) const;
+    bool check_genesis(const gs::slp_record & record, const overlay* pending, slp_validation_cost & cost) const;
 
+    // does not cache the result or write to the validator, validate(txid) does
+    // what it took is added to cost, but not to stats
+    bool validate(
+        const gs::txid & txid,
+        const gs::slp_record & record,
+        const overlay* pending,
+        slp_validation_cost & cost
+    ) const;
     bool validate(const gs::transaction & tx);
     bool validate(const gs::txid & txid);
+
+private:
+    // inserts tx into records and store, false if the store refused it
+    bool store_tx(const gs::transaction& tx, bool& inserted);
+
+    bool is_valid(const gs::txid& txid, const overlay* pending, slp_validation_cost & cost) const;
+    const gs::slp_record* find_record(const gs::txid& txid, slp_validation_cost & cost) const;
+    const mint_baton* find_mint_baton(const gs::outpoint& outpoint, const overlay* pending, slp_validation_cost & cost) const;
+
+    void add_invalid(const gs::txid & txid, const gs::slp_record & record);
+    void forget_invalid(const gs::txid & txid);
+    void forget_invalid_spenders(const gs::txid & txid);
 };
 
 }
@@ -0,0 +1,62 @@
+#ifndef GS_SLP_VALIDATOR_SNAPSHOT_HPP
+#define GS_SLP_VALIDATOR_SNAPSHOT_HPP
+
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <gs++/bhash.hpp>
+#include <gs++/slp_validator.hpp>
+
+namespace gs {
+
+// on disk image of the records, txdata and valid set of an slp_validator
+//
+// header is the one of snapshot_io.hpp with magic "GSSLPVAL"
+// body
+//   uint64    record count
+//   per record
+//     uint8[32] txid
+//     uint8[32] tokenid
+//     uint32    output count, mint baton vout, input count (i), amount count (a), txdata bytes
+//     uint16    token type
+//     uint8     slp transaction type
+//     uint8     padding
+//     per input uint8[32] txid, uint32 vout
+//     uint64    amounts[a]
+//     uint8     txdata[txdata bytes]
+//     padding to 8 bytes
+//   uint64    valid txid count
+//   uint8[32] valid txids
+//
+// mint batons are derived from the valid records, rejected ones are not kept
+// only confirmed transactions are written, the mempool is validated again on start
+// once loaded the mapping stays around and txdata is served straight out of it
+struct slp_validator_snapshot
+{
+    constexpr static std::uint32_t version { 2 };
+
+    std::uint32_t height;
+    gs::blockhash block_hash;
+
+    slp_validator_snapshot()
+    : height(0)
+    {}
+
+    // written to path.tmp first and then renamed over path
+    // records and valid txids for which confirmed returns false are left out
+    bool save(
+        const std::string& path,
+        const slp_validator& validator,
+        const std::function<bool(const gs::txid&)>& confirmed
+    );
+
+    // validator should be empty, nothing is inserted unless the whole image checks out
+    bool load(
+        const std::string& path,
+        slp_validator& validator
+    );
+};
+
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include <gs++/bhash.hpp>
 #include <gs++/slp_token.hpp>
 #include <gs++/slp_transaction.hpp>
+#include <gs++/tx_store.hpp>
 
 
 namespace gs {
@@ -23,6 +24,34 @@ struct slpdb
     absl::flat_hash_map<gs::tokenid, gs::slp_token> tokens;
     absl::flat_hash_map<gs::outpoint, gs::tokenid> utxo_to_tokenid;
 
+    gs::tx_store& store;
+
+    slpdb(gs::tx_store& store = gs::tx_store::shared())
+    : store(store)
+    {}
+
+    ~slpdb()
+    {
+        for (const auto & m : tokens) {
+            for (const auto & t : m.second.transactions) {
+                store.release(t.first);
+            }
+        }
+    }
+
+    // the token keeps a handle, the bytes are shared with everything else holding tx
+    void add_token_transaction(gs::slp_token& token, const gs::transaction& tx)
+    {
+        gs::tx_handle handle;
+        if (token.transactions.count(tx.txid)
+         || ! store.acquire(tx.txid, tx.serialized.data(), tx.serialized.size(), handle)
+        ) {
+            return;
+        }
+
+        token.transactions.emplace(tx.txid, handle);
+    }
+
     void add_transaction(const gs::transaction& tx)
     {
         boost::lock_guard<boost::shared_mutex> lock(lookup_mtx);
@@ -48,6 +77,7 @@ struct slpdb
             auto token_search = tokens.find(tokenid);
             assert(token_search != tokens.end()); // should never happen
             gs::slp_token & token = token_search->second;
+            add_token_transaction(token, tx);
 
             const gs::outpoint outpoint(tx.txid, 1);
             token.utxos.emplace(std::piecewise_construct,
@@ -93,7 +123,7 @@ struct slpdb
                 return;
             }
 
-            token.transactions.insert({ tx.txid, tx });
+            add_token_transaction(token, tx);
 
             const gs::outpoint outpoint(tx.txid, 1);
             token.utxos.emplace(std::piecewise_construct,
@@ -153,7 +183,7 @@ struct slpdb
                 utxo_to_tokenid.insert({ outpoint, tx.slp.tokenid });
             }
 
-            token.transactions.insert({ tx.txid, tx });
+            add_token_transaction(token, tx);
 
             // spdlog::info("send end");
         }
@@ -0,0 +1,301 @@
+#ifndef GS_SNAPSHOT_IO_HPP
+#define GS_SNAPSHOT_IO_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <spdlog/spdlog.h>
+
+#include <gs++/bhash.hpp>
+
+namespace gs {
+
+// shared by the on disk images, each one has its own magic and version
+//
+// header (64 bytes)
+//   char[8]   magic
+//   uint32    version
+//   uint32    block height the image was taken at
+//   uint8[32] block hash
+//   uint64    body size in bytes (multiple of 8)
+//   uint64    checksum of the body
+
+constexpr std::size_t   snapshot_header_size = 64;
+constexpr std::uint64_t snapshot_checksum_init = 0xcbf29ce484222325ULL;
+
+// mixed in one 8 byte word at a time so a whole image can be checked at memory speed
+inline std::uint64_t snapshot_checksum_word(std::uint64_t h, const std::uint64_t word)
+{
+    h = (h ^ word) * 0x100000001b3ULL;
+    return h ^ (h >> 32);
+}
+
+struct snapshot_header
+{
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t height;
+    std::uint8_t  block_hash[32];
+    std::uint64_t body_size;
+    std::uint64_t checksum;
+};
+static_assert(sizeof(snapshot_header) == snapshot_header_size, "snapshot header must be 64 bytes");
+
+class snapshot_writer
+{
+public:
+    std::ofstream out;
+    std::uint64_t size;
+    std::uint64_t checksum;
+
+    // space for the header is left at the start, see finish
+    snapshot_writer(const std::string& path)
+    : out(path, std::ios::binary | std::ios::trunc)
+    , size(0)
+    , checksum(snapshot_checksum_init)
+    , word_size(0)
+    {
+        snapshot_header header;
+        std::memset(&header, 0, sizeof(header));
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    void write(const void* data, const std::size_t n)
+    {
+        out.write(reinterpret_cast<const char*>(data), n);
+
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(data);
+        for (std::size_t i=0; i<n; ++i) {
+            word[word_size++] = p[i];
+            if (word_size == sizeof(word)) {
+                std::uint64_t w;
+                std::memcpy(&w, word, sizeof(w));
+                checksum = snapshot_checksum_word(checksum, w);
+                word_size = 0;
+            }
+        }
+
+        size += n;
+    }
+
+    template <typename T>
+    void write_vector(const std::vector<T>& v)
+    { write(v.data(), v.size() * sizeof(T)); }
+
+    void write_u64(const std::uint64_t v)
+    { write(&v, sizeof(v)); }
+
+    void pad()
+    {
+        const std::uint8_t zero = 0;
+        while (size % 8 != 0) {
+            write(&zero, 1);
+        }
+    }
+
+    // fills in the header and renames the image from tmp_path over path, label is for logging
+    bool finish(
+        const char (&magic)[8],
+        const std::uint32_t version,
+        const std::uint32_t height,
+        const gs::blockhash& block_hash,
+        const std::string& tmp_path,
+        const std::string& path,
+        const char* label
+    ) {
+        snapshot_header header;
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version   = version;
+        header.height    = height;
+        std::memcpy(header.block_hash, block_hash.data(), sizeof(header.block_hash));
+        header.body_size = size;
+        header.checksum  = checksum;
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.close();
+
+        if (! out) {
+            spdlog::error("{}: could not write {}", label, tmp_path);
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            spdlog::error("{}: could not rename {} to {}", label, tmp_path, path);
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    std::uint8_t word[8];
+    unsigned     word_size;
+};
+
+class snapshot_reader
+{
+public:
+    snapshot_reader(const std::uint8_t* data, const std::size_t size)
+    : data(data)
+    , size(size)
+    , pos(0)
+    {}
+
+    bool read(void* dst, const std::uint64_t n)
+    {
+        if (n > size - pos) {
+            return false;
+        }
+
+        std::memcpy(dst, data + pos, n);
+        pos += n;
+        return true;
+    }
+
+    template <typename T>
+    bool read_vector(std::vector<T>& v, const std::uint64_t n)
+    {
+        if (n > (size - pos) / sizeof(T)) {
+            return false;
+        }
+
+        v.resize(n);
+        return read(v.data(), n * sizeof(T));
+    }
+
+    bool read_u64(std::uint64_t& v)
+    { return read(&v, sizeof(v)); }
+
+    // points into the image instead of copying, nullptr if it runs past the end
+    const std::uint8_t* view(const std::uint64_t n)
+    {
+        if (n > size - pos) {
+            return nullptr;
+        }
+
+        const std::uint8_t* ret = data + pos;
+        pos += n;
+        return ret;
+    }
+
+    bool pad()
+    {
+        pos = (pos + 7) & ~static_cast<std::size_t>(7);
+        return pos <= size;
+    }
+
+    bool done() const
+    { return pos == size; }
+
+private:
+    const std::uint8_t* data;
+    std::size_t         size;
+    std::size_t         pos;
+};
+
+// read only mapping of a whole file
+class snapshot_mapping
+{
+public:
+    const std::uint8_t* data;
+    std::size_t         size;
+
+    snapshot_mapping(const std::string& path)
+    : data(nullptr)
+    , size(0)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                data = reinterpret_cast<const std::uint8_t*>(p);
+                size = st.st_size;
+            }
+        }
+
+        close(fd);
+    }
+
+    ~snapshot_mapping()
+    {
+        if (data) {
+            munmap(const_cast<std::uint8_t*>(data), size);
+        }
+    }
+
+    snapshot_mapping(const snapshot_mapping&) = delete;
+    snapshot_mapping& operator=(const snapshot_mapping&) = delete;
+
+    // checks the header and checksum, on success the body follows the header
+    bool check(
+        const char (&magic)[8],
+        const std::uint32_t version,
+        const std::string& path,
+        const char* label,
+        snapshot_header& header
+    ) const {
+        if (data == nullptr) {
+            spdlog::warn("{}: could not map {}", label, path);
+            return false;
+        }
+
+        if (size < snapshot_header_size) {
+            spdlog::error("{}: {} is truncated", label, path);
+            return false;
+        }
+
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0) {
+            spdlog::error("{}: {} is not a snapshot", label, path);
+            return false;
+        }
+
+        if (header.version != version) {
+            spdlog::error("{}: {} has version {} expected {}", label, path, header.version, version);
+            return false;
+        }
+
+        if (header.body_size != size - snapshot_header_size || header.body_size % 8 != 0) {
+            spdlog::error("{}: {} is truncated", label, path);
+            return false;
+        }
+
+        const std::uint8_t* body = data + snapshot_header_size;
+        std::uint64_t checksum = snapshot_checksum_init;
+        for (std::size_t i=0; i<header.body_size; i += 8) {
+            std::uint64_t w;
+            std::memcpy(&w, body + i, sizeof(w));
+            checksum = snapshot_checksum_word(checksum, w);
+        }
+
+        if (checksum != header.checksum) {
+            spdlog::error("{}: {} failed checksum", label, path);
+            return false;
+        }
+
+        return true;
+    }
+};
+
+}
+
+#endif
@@ -1,22 +1,157 @@
 #ifndef GS_TOKEN_DETAILS_HPP
 #define GS_TOKEN_DETAILS_HPP
 
-#include <absl/container/node_hash_map.h>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <boost/thread.hpp>
+#include <absl/container/flat_hash_map.h>
 #include <gs++/graph_node.hpp>
 #include <gs++/bhash.hpp>
+#include <gs++/tx_store.hpp>
+#include <gs++/ancestor_sketch.hpp>
 
 namespace gs {
 
+// height recorded for transactions which are not yet in a block
+constexpr std::uint32_t unconfirmed_height = std::numeric_limits<std::uint32_t>::max();
+
+// end of a spend list
+constexpr std::uint32_t no_spend = std::numeric_limits<std::uint32_t>::max();
+
+// output vout of some node spent by node, next is the following entry of the same list
+struct spend_edge
+{
+    graph_node_id node;
+    std::uint32_t vout;
+    std::uint32_t next;
+};
+
+// all nodes of a token live in a handful of flat arrays
+// txid of node n is txids[n], confirmed at heights[n]
+// bytes of node n are in store under the handle txdata[n], the token holds one reference per node
+// inputs of node n are inputs[input_offsets[n], input_offsets[n+1]) (compressed sparse row)
+// inputs of node n found in the parent layer (the token with the same tokenid in
+// txgraph::parent) are parent_inputs[parent_input_offsets[n], parent_input_offsets[n+1])
+//
+// spenders of node n are a list through spends starting at spends_head[n], one entry per
+// spent output, spenders of parent layer node p start at parent_spends_head[p] instead
+// new entries are pushed at the head so next always points to an earlier entry
+//
+// sketches[n] estimates the ancestors of node n across this and the parent layers
+//
+// nodes and edges are append only, an input always refers to a node
+// which was inserted before (or in the same batch as) its spender
 struct token_details
 {
-    gs::tokenid                               tokenid;
-    absl::node_hash_map<gs::txid, graph_node> graph;
+    gs::tx_store& store;
+
+    boost::shared_mutex mtx; // IMPORTANT: everything below must be guarded with the mtx
+
+    gs::tokenid                                  tokenid;
+    absl::flat_hash_map<gs::txid, graph_node_id> nodes;
+    std::vector<gs::txid>                        txids;
+    std::vector<std::uint32_t>                   heights;
+
+    std::vector<gs::tx_handle> txdata;
 
-    token_details () {}
+    std::vector<std::uint32_t> input_offsets;
+    std::vector<graph_node_id> inputs;
 
-    token_details (const gs::tokenid& tokenid)
-    : tokenid(tokenid)
+    std::vector<std::uint32_t> parent_input_offsets;
+    std::vector<graph_node_id> parent_inputs;
+
+    std::vector<std::uint32_t> spends_head;
+    std::vector<spend_edge>    spends;
+    absl::flat_hash_map<graph_node_id, std::uint32_t> parent_spends_head;
+
+    std::vector<gs::ancestor_sketch> sketches;
+
+    token_details (gs::tx_store& store)
+    : store(store)
+    , input_offsets({ 0 })
+    , parent_input_offsets({ 0 })
     {}
+
+    token_details (gs::tx_store& store, const gs::tokenid& tokenid)
+    : store(store)
+    , tokenid(tokenid)
+    , input_offsets({ 0 })
+    , parent_input_offsets({ 0 })
+    {}
+
+    ~token_details ()
+    {
+        for (const gs::txid & txid : txids) {
+            store.release(txid);
+        }
+    }
+
+    token_details (const token_details&) = delete;
+    token_details& operator=(const token_details&) = delete;
+
+    std::size_t size() const
+    { return txids.size(); }
+
+    const std::uint8_t* txdata_begin(const graph_node_id id) const
+    { return store.data(txdata[id]); }
+
+    std::size_t txdata_size(const graph_node_id id) const
+    { return txdata[id].size; }
+
+    const graph_node_id* inputs_begin(const graph_node_id id) const
+    { return inputs.data() + input_offsets[id]; }
+
+    const graph_node_id* inputs_end(const graph_node_id id) const
+    { return inputs.data() + input_offsets[id+1]; }
+
+    const graph_node_id* parent_inputs_begin(const graph_node_id id) const
+    { return parent_inputs.data() + parent_input_offsets[id]; }
+
+    const graph_node_id* parent_inputs_end(const graph_node_id id) const
+    { return parent_inputs.data() + parent_input_offsets[id+1]; }
+
+    // derives sketches[id] from the inputs of id, which must be linked already
+    // inputs later in the same batch have no sketch yet and are left out
+    void update_sketch(const graph_node_id id, const token_details* parent_token)
+    {
+        gs::ancestor_sketch sketch;
+        sketch.insert(txids[id]);
+
+        double weighted_size = txdata_size(id);
+        double weight = 1;
+        const auto add = [&](const gs::ancestor_sketch& input) {
+            const double count = input.count();
+            sketch.merge(input);
+            weighted_size += count * input.mean_size;
+            weight += count;
+        };
+
+        for (auto it = inputs_begin(id); it != inputs_end(id); ++it) {
+            if (*it < id) {
+                add(sketches[*it]);
+            }
+        }
+
+        if (parent_token) {
+            for (auto it = parent_inputs_begin(id); it != parent_inputs_end(id); ++it) {
+                add(parent_token->sketches[*it]);
+            }
+        }
+
+        sketch.mean_size = static_cast<float>(weighted_size / weight);
+
+        if (sketches.size() <= id) {
+            sketches.resize(id + 1);
+        }
+        sketches[id] = sketch;
+    }
+
+    void add_spend(std::uint32_t& head, const graph_node_id spender, const std::uint32_t vout)
+    {
+        spends.push_back(spend_edge { spender, vout, head });
+        head = static_cast<std::uint32_t>(spends.size() - 1);
+    }
 };
 
 }
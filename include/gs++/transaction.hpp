@@ -112,10 +112,8 @@ struct transaction
                 return false;
             }
             
+            // sigscripts are not kept, so they are skipped instead of copied
             CHECK_END(script_len);
-            std::vector<std::uint8_t> sigscript;
-            sigscript.resize(script_len);
-            std::copy(it, it+script_len, sigscript.begin());
             it+=script_len;
 
             CHECK_END(4);
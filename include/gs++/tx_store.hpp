@@ -0,0 +1,140 @@
+#ifndef GS_TX_STORE_HPP
+#define GS_TX_STORE_HPP
+
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <absl/container/flat_hash_map.h>
+#include <gs++/bhash.hpp>
+
+namespace gs {
+
+// where the bytes of one transaction live inside a tx_store
+struct tx_handle
+{
+    std::uint64_t offset;
+    std::uint32_t size;
+
+    tx_handle()
+    : offset(0)
+    , size(0)
+    {}
+
+    tx_handle(const std::uint64_t offset, const std::uint32_t size)
+    : offset(offset)
+    , size(size)
+    {}
+};
+
+// serialized transactions keyed by txid, each one is stored once
+// no matter how many of the validator, txgraph and slpdb hold it
+//
+// bytes live in fixed size chunks which are never moved or freed, so data()
+// does not need the lock. entries are reference counted and the bytes of an
+// entry stay put for as long as anyone holds a reference, once the last one
+// is released they go on a free list and are reused by later transactions
+//
+// a region lends the store bytes it does not own (a mapped snapshot image),
+// it takes up consecutive chunk slots so data() works the same inside of it
+// ranges of a region are never reused
+class tx_store
+{
+public:
+    constexpr static std::size_t chunk_bits = 24; // larger than any transaction
+    constexpr static std::size_t chunk_size = std::size_t(1) << chunk_bits;
+    constexpr static std::size_t max_chunks = std::size_t(1) << 16;
+
+    tx_store();
+    ~tx_store();
+
+    tx_store(const tx_store&) = delete;
+    tx_store& operator=(const tx_store&) = delete;
+
+    // adds a reference to txid, its bytes are copied in when it is not stored yet
+    bool acquire(
+        const gs::txid& txid,
+        const std::uint8_t* data,
+        const std::size_t size,
+        tx_handle& handle
+    );
+
+    // adds a reference to a txid which is already stored
+    bool acquire(const gs::txid& txid);
+
+    // lends the store size bytes at data, owner is kept alive for the life of the store
+    // base is the offset of data[0], a transaction at data[i] has the handle offset base+i
+    bool add_region(
+        const std::uint8_t* data,
+        const std::size_t size,
+        std::shared_ptr<const void> owner,
+        std::uint64_t& base
+    );
+
+    // same as acquire but the bytes are already inside of a region at handle,
+    // handle is set to the stored one, which differs if txid was stored before
+    bool acquire_region(
+        const gs::txid& txid,
+        tx_handle& handle
+    );
+
+    // drops a reference, the entry is forgotten and its bytes are
+    // freed when none are left, data() of it must not be used after that
+    void release(const gs::txid& txid);
+
+    bool find(const gs::txid& txid, tx_handle& handle);
+
+    const std::uint8_t* data(const tx_handle& handle) const
+    { return chunks[handle.offset >> chunk_bits].load() + (handle.offset & (chunk_size - 1)); }
+
+    std::vector<std::uint8_t> copy(const tx_handle& handle) const
+    { return std::vector<std::uint8_t>(data(handle), data(handle) + handle.size); }
+
+    std::size_t size();
+
+    // bytes of the transactions stored now, released ones are not counted
+    std::uint64_t bytes();
+
+    // bytes released and waiting to be reused
+    std::uint64_t free_bytes();
+
+    // store used by everything which is not given one
+    static tx_store& shared();
+
+private:
+    struct entry
+    {
+        tx_handle     handle;
+        std::uint32_t refs;
+    };
+
+    // size bytes inside of a chunk, the lock must be held
+    bool allocate(const std::size_t size, std::uint64_t& offset);
+
+    // puts a range back on the free list merged with its neighbours, the lock must be held
+    void free_range(std::uint64_t offset, std::uint64_t size);
+
+    void insert_free(const std::uint64_t offset, const std::uint64_t size);
+    void erase_free(const std::map<std::uint64_t, std::uint64_t>::iterator it);
+
+    std::mutex mtx; // IMPORTANT: everything below must be guarded with the mtx
+    absl::flat_hash_map<gs::txid, entry> entries;
+    std::unique_ptr<std::atomic<std::uint8_t*>[]> chunks;
+    std::uint64_t next; // offset of the first byte which was never handed out
+    std::uint64_t used; // bytes of the stored transactions
+
+    // released ranges, a range never crosses a chunk boundary
+    std::map<std::uint64_t, std::uint64_t>            free_by_offset; // offset to size
+    std::set<std::pair<std::uint64_t, std::uint64_t>> free_by_size;   // (size, offset), for best fit
+    std::uint64_t                                     free_total;
+
+    std::vector<bool>                        borrowed; // chunks which belong to a region
+    std::vector<std::shared_ptr<const void>> region_owners;
+};
+
+}
+
+#endif
@@ -3,12 +3,17 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <atomic>
+#include <memory>
 #include <boost/thread.hpp>
 #include <absl/container/flat_hash_set.h>
-#include <absl/container/node_hash_map.h>
+#include <absl/container/flat_hash_map.h>
 #include <gs++/transaction.hpp>
 #include <gs++/graph_node.hpp>
 #include <gs++/token_details.hpp>
+#include <gs++/tx_store.hpp>
+#include <gs++/txid_filter.hpp>
 #include <gs++/bhash.hpp>
 
 namespace gs {
@@ -18,35 +23,307 @@ enum class graph_search_status
     OK,                // normal response
     NOT_FOUND,         // could be invalid slp token or we havent seen it yet
     NOT_IN_TOKENGRAPH, // error: if found it should be in tokengraph
+    CANCELLED,         // options.cancelled returned true, results are incomplete
+    LIMIT_EXCEEDED,    // options.max_nodes or options.max_bytes was hit, results are incomplete
 };
 
 using graph_search_response = std::pair<graph_search_status, std::vector<std::vector<std::uint8_t>>>;
 
-struct txgraph
+// approximate size of a full graph_search, see ancestor_sketch
+struct graph_search_estimate_result
+{
+    double ancestors; // transactions, lookup included
+    double bytes;     // txdata of all of them
+
+    graph_search_estimate_result()
+    : ancestors(0)
+    , bytes(0)
+    {}
+};
+
+// pruning applied during a search, pruned nodes are neither visited nor descended into
+//
+// limits are counted over everything walked with the same graph_search_seen, so a
+// request building exclusions and searching several txids shares one budget
+struct graph_search_options
+{
+    const txid_filter* exclude_filter; // txids the client already has
+    std::uint32_t      trusted_height; // confirmed at or below this height, 0 to disable
+    bool               prune_lookup;   // whether the lookup txid itself may be pruned
+
+    std::function<bool()> cancelled; // polled every few hundred nodes, may be empty
+    std::size_t           max_nodes; // nodes walked including exclusions, 0 to disable
+    std::size_t           max_bytes; // txdata bytes visited, 0 to disable
+
+    graph_search_options()
+    : exclude_filter(nullptr)
+    , trusted_height(0)
+    , prune_lookup(false)
+    , max_nodes(0)
+    , max_bytes(0)
+    {}
+};
+
+// nodes which have already been visited or excluded during a search
+//
+// node ids are dense inside of a token so each token gets an array of epoch
+// stamps indexed by node id, a node is seen when its stamp equals the epoch.
+// the arrays are leased from a thread local pool and returned on destruction
+// so bumping the epoch is all it takes to reuse one for the next search
+class graph_search_seen
+{
+public:
+    struct buffer
+    {
+        std::vector<std::uint32_t> stamps;
+        std::uint32_t              epoch;
+        std::vector<graph_node_id> stack; // scratch space for traversals
+
+        buffer()
+        : epoch(0)
+        {}
+    };
+
+    // visited marks of a single token, cheap to copy
+    class token_marks
+    {
+    public:
+        token_marks(buffer* buf)
+        : buf(buf)
+        {}
+
+        // returns true if id was not seen before
+        bool insert(const graph_node_id id)
+        {
+            std::uint32_t& stamp = buf->stamps[id];
+            if (stamp == buf->epoch) {
+                return false;
+            }
+            stamp = buf->epoch;
+            return true;
+        }
+
+        bool contains(const graph_node_id id) const
+        { return buf->stamps[id] == buf->epoch; }
+
+        std::vector<graph_node_id>& stack()
+        { return buf->stack; }
+
+    private:
+        buffer* buf;
+    };
+
+    graph_search_seen()
+    : nodes(0)
+    , bytes(0)
+    , abort_status(graph_search_status::OK)
+    {}
+
+    graph_search_seen(const graph_search_seen&) = delete;
+    graph_search_seen& operator=(const graph_search_seen&) = delete;
+
+    ~graph_search_seen();
+
+    // marks are sized to cover every node currently in token
+    // the lease holds on to token, so a token replaced during the search can not
+    // be allocated at the same address and pick up marks which are not its own
+    token_marks get(const std::shared_ptr<token_details>& token);
+
+    // counts one walked node of size txdata bytes against the limits of options
+    // returns false once a limit is hit or the search was cancelled, and from then on
+    bool charge(const graph_search_options& options, const std::size_t size);
+
+    bool aborted() const
+    { return abort_status != graph_search_status::OK; }
+
+    // CANCELLED or LIMIT_EXCEEDED once aborted, OK before
+    graph_search_status status() const
+    { return abort_status; }
+
+private:
+    std::vector<std::pair<std::shared_ptr<const token_details>, buffer*>> leases; // searches touch few tokens
+
+    std::size_t         nodes;
+    std::size_t         bytes;
+    graph_search_status abort_status;
+};
+
+// called once for each transaction found by a search, txdata points directly
+// into graph storage and stays valid for as long as the graph_search_seen of
+// the search, which holds on to every token it walked
+using graph_search_visitor = std::function<void(const std::uint8_t* txdata, const std::size_t size)>;
+
+// same as graph_search_visitor but gets the node itself, called with the token locked
+using graph_node_visitor = std::function<void(const token_details* token, const graph_node_id id)>;
+
+// transactions of a search ordered so each one comes after every input it has in the result
+// inputs of txdata[i] found in the result are at indices parents[parent_offsets[i], parent_offsets[i+1])
+// txdata points into the graph's tx_store and is valid as long as the graph_search_seen of the search
+struct graph_search_ordered_result
 {
-    absl::node_hash_map<gs::tokenid, token_details>  tokens;
-    absl::node_hash_map<gs::txid,    token_details*> txid_to_token;
-    boost::shared_mutex lookup_mtx; // IMPORTANT: tokens and txid_to_token must be guarded with the lookup_mtx
+    std::vector<std::pair<const std::uint8_t*, std::size_t>> txdata;
+    std::vector<std::uint32_t> parent_offsets;
+    std::vector<std::uint32_t> parents;
 
-    txgraph()
+    graph_search_ordered_result()
+    : parent_offsets({ 0 })
     {}
+};
+
+struct txgraph
+{
+    // tokens are shared so a search can keep using one while it is being replaced or cleared,
+    // each token has its own lock so inserting into one token never blocks searches of another
+    absl::flat_hash_map<gs::tokenid, std::shared_ptr<token_details>> tokens;
+    absl::flat_hash_map<gs::txid,    token_details*>                 txid_to_token;
+    boost::shared_mutex lookup_mtx; // IMPORTANT: tokens and txid_to_token must be guarded with the lookup_mtx, only hold it briefly
+    std::atomic<std::uint64_t> generation; // bumped whenever nodes are added or removed
+    // bumped only when nodes are removed or the graph is replaced, inserts never
+    // change the ancestors of existing nodes so searches of them stay good across those
+    std::atomic<std::uint64_t> epoch;
+
+    // layer below this one (the confirmed graph below the mempool graph)
+    // inputs found there are linked on insert and searches continue into it
+    // nodes of the parent must stay put while this graph links to them
+    txgraph* parent;
+
+    // layer above this one, set when the child is constructed
+    // descendant searches continue into it through its parent_spends_head
+    txgraph* child;
+
+    // transaction bytes are held here, nodes only keep handles
+    gs::tx_store& store;
+
+    txgraph(txgraph* parent = nullptr, gs::tx_store& store = gs::tx_store::shared())
+    : generation(1)
+    , epoch(1)
+    , parent(parent)
+    , child(nullptr)
+    , store(store)
+    {
+        if (parent) {
+            parent->child = this;
+        }
+    }
+
+    ~txgraph()
+    {
+        if (parent && parent->child == this) {
+            parent->child = nullptr;
+        }
+    }
 
     void clear();
 
+    // only the limits and cancellation of options apply, nothing is pruned
+    // returns false if lookup_txid is missing or the walk was aborted
     bool build_exclusion_set(
         const gs::txid lookup_txid,
-        absl::flat_hash_set<const graph_node*>& seen
+        graph_search_seen& seen,
+        const graph_search_options& options = graph_search_options()
+    );
+
+    // marks only txid itself as seen, searches stop there but
+    // its ancestors may still be reached through other paths
+    bool mark_seen(
+        const gs::txid txid,
+        graph_search_seen& seen
     );
 
     // this will modify the exclusion set so keep in mind
+    // lookup_txid is only visited if it was not already seen
+    graph_search_status graph_search(
+        const gs::txid lookup_txid,
+        graph_search_seen& seen,
+        const graph_search_visitor& visitor,
+        const graph_search_options& options = graph_search_options()
+    );
+
+    // same as graph_search but copies every transaction into the response
     graph_search_response graph_search__ptr(
         const gs::txid lookup_txid,
-        absl::flat_hash_set<const graph_node*>& seen
+        graph_search_seen& seen,
+        const graph_search_options& options = graph_search_options()
+    );
+
+    // same as graph_search but collects the result in topological order with a parent table
+    graph_search_status graph_search_ordered(
+        const gs::txid lookup_txid,
+        graph_search_seen& seen,
+        graph_search_ordered_result& result,
+        const graph_search_options& options = graph_search_options()
+    );
+
+    // graph_search without turning nodes into txdata
+    graph_search_status graph_search_nodes(
+        const gs::txid lookup_txid,
+        graph_search_seen& seen,
+        const graph_node_visitor& visitor,
+        const graph_search_options& options
+    );
+
+    // what graph_search would return without exclusions or pruning, in constant time
+    graph_search_status graph_search_estimate(
+        const gs::txid lookup_txid,
+        graph_search_estimate_result& result
+    );
+
+    // visits lookup_txid and every transaction which spends from it, directly or not,
+    // in this layer and the layers above
+    // pruned spenders are neither visited nor searched past
+    graph_search_status descendant_search(
+        const gs::txid lookup_txid,
+        graph_search_seen& seen,
+        const graph_search_visitor& visitor,
+        const graph_search_options& options = graph_search_options()
+    );
+
+    graph_search_response descendant_search__ptr(
+        const gs::txid lookup_txid,
+        graph_search_seen& seen,
+        const graph_search_options& options = graph_search_options()
+    );
+
+    // txid of the transaction in this layer or the one above which spends outpoint
+    // spends by transactions outside of the token graph (burns) are not known
+    bool find_spender(
+        const gs::outpoint& outpoint,
+        gs::txid& spender
     );
 
     unsigned insert_token_data (
         const gs::tokenid & tokenid,
-        const std::vector<gs::transaction> & txs
+        const std::vector<gs::transaction> & txs,
+        const std::uint32_t height = unconfirmed_height
+    );
+
+    // tokens which lose nodes are rebuilt without them, so this is
+    // meant for the mempool graph where tokens stay small
+    // must not run concurrently with insert_token_data
+    unsigned remove_token_data (
+        const std::vector<gs::txid> & txids
+    );
+
+    // token which contains txid, or nullptr
+    std::shared_ptr<token_details> find_token(const gs::txid & txid);
+    std::shared_ptr<token_details> find_token(const gs::tokenid & tokenid);
+
+    // continues a search at nodes of the parent layer
+    void search_parent_layer(
+        const gs::tokenid& tokenid,
+        const std::vector<graph_node_id>& roots,
+        graph_search_seen& seen,
+        const graph_node_visitor* visitor,
+        const graph_search_options& options
+    );
+
+    // continues a descendant search at nodes of the child layer spending parent_nodes
+    void search_child_layer(
+        const gs::tokenid& tokenid,
+        const std::vector<graph_node_id>& parent_nodes,
+        graph_search_seen& seen,
+        const graph_search_visitor& visitor,
+        const graph_search_options& options
     );
 
 };
@@ -0,0 +1,70 @@
+#ifndef GS_TXGRAPH_SNAPSHOT_HPP
+#define GS_TXGRAPH_SNAPSHOT_HPP
+
+#include <string>
+#include <cstdint>
+#include <absl/container/flat_hash_set.h>
+#include <gs++/bhash.hpp>
+#include <gs++/txgraph.hpp>
+
+namespace gs {
+
+// on disk image of a confirmed txgraph and the validator's valid set
+// valid txids which are not nodes of the graph (the mempool) are left out
+//
+// the image only contains offsets so it can be mapped anywhere, integers are in host byte order
+// once loaded the mapping stays around and txdata is served straight out of it
+//
+// header (64 bytes)
+//   char[8]   magic "GSTXGRPH"
+//   uint32    version
+//   uint32    block height the image was taken at
+//   uint8[32] block hash
+//   uint64    body size in bytes (multiple of 8)
+//   uint64    checksum of the body
+// body
+//   uint64    token count
+//   per token
+//     uint8[32] tokenid
+//     uint64    node count (n), txdata bytes, input count, spend count
+//     uint8[32] txids[n]
+//     uint32    heights[n]
+//     uint64    txdata_offsets[n+1]
+//     uint32    input_offsets[n+1]
+//     uint32    inputs[input count]
+//     uint32    spends_head[n]
+//     uint32    spends[spend count][3] (node, vout, next)
+//     uint8     sketches[n][36] (32 registers, float mean size)
+//     uint8     txdata[txdata bytes]
+//     padding to 8 bytes
+//   uint64    valid txid count
+//   uint8[32] valid txids
+struct txgraph_snapshot
+{
+    constexpr static std::uint32_t version { 4 };
+
+    std::uint32_t height;
+    gs::blockhash block_hash;
+
+    txgraph_snapshot()
+    : height(0)
+    {}
+
+    // written to path.tmp first and then renamed over path
+    bool save(
+        const std::string& path,
+        txgraph& g,
+        const absl::flat_hash_set<gs::txid>& valid
+    );
+
+    // g should be empty, nothing is inserted unless the whole image checks out
+    bool load(
+        const std::string& path,
+        txgraph& g,
+        absl::flat_hash_set<gs::txid>& valid
+    );
+};
+
+}
+
+#endif
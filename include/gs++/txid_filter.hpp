@@ -0,0 +1,85 @@
+#ifndef GS_TXID_FILTER_HPP
+#define GS_TXID_FILTER_HPP
+
+#include <vector>
+#include <cstdint>
+#include <gs++/bhash.hpp>
+
+namespace gs {
+
+// bloom filter of txids supplied by a client
+//
+// txids are already uniformly distributed so no extra hashing is done,
+// bit i of n_hash_funcs is (h1 + i*h2) mod (8 * bits.size()) where
+//   h1 = little endian uint64 of txid bytes [0, 8) xor tweak
+//   h2 = little endian uint64 of txid bytes [8, 16) or 1
+// txid bytes are in internal (not reversed) order
+// bit b lives in bits[b / 8] under mask (1 << (b % 8))
+struct txid_filter
+{
+    std::vector<std::uint8_t> bits;
+    std::uint32_t             n_hash_funcs;
+    std::uint64_t             tweak;
+
+    txid_filter()
+    : n_hash_funcs(0)
+    , tweak(0)
+    {}
+
+    txid_filter(
+        const std::vector<std::uint8_t>& bits,
+        const std::uint32_t n_hash_funcs,
+        const std::uint64_t tweak
+    )
+    : bits(bits)
+    , n_hash_funcs(n_hash_funcs)
+    , tweak(tweak)
+    {}
+
+    bool empty() const
+    { return bits.empty() || n_hash_funcs == 0; }
+
+    void insert(const gs::txid& txid)
+    {
+        const std::uint64_t m = bits.size() * 8;
+        std::uint64_t h = h1(txid);
+        for (std::uint32_t i=0; i<n_hash_funcs; ++i, h += h2(txid)) {
+            const std::uint64_t b = h % m;
+            bits[b >> 3] |= (1 << (b & 7));
+        }
+    }
+
+    bool contains(const gs::txid& txid) const
+    {
+        const std::uint64_t m = bits.size() * 8;
+        std::uint64_t h = h1(txid);
+        for (std::uint32_t i=0; i<n_hash_funcs; ++i, h += h2(txid)) {
+            const std::uint64_t b = h % m;
+            if (! (bits[b >> 3] & (1 << (b & 7)))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    static std::uint64_t le64(const gs::txid& txid, const unsigned offset)
+    {
+        std::uint64_t ret = 0;
+        for (unsigned i=0; i<8; ++i) {
+            ret |= static_cast<std::uint64_t>(txid.v[offset+i]) << (i*8);
+        }
+        return ret;
+    }
+
+    std::uint64_t h1(const gs::txid& txid) const
+    { return le64(txid, 0) ^ tweak; }
+
+    static std::uint64_t h2(const gs::txid& txid)
+    { return le64(txid, 8) | 1; }
+};
+
+}
+
+#endif
@@ -14,15 +14,17 @@ const cors = require("cors")
 const bitcore = require('bitcore-lib-cash');
 const cashaddrjs = require('cashaddrjs');
 
+// graph searches are streamed in batches of about stream_batch_bytes (1 MiB by default)
+// so the default receive limit is enough for them
 const graphSearchClient = new graphsearch_service.GraphSearchServiceClient(
   process.env.graphsearch_grpc_server_bind,
   grpc.credentials.createInsecure(),
   {
-     'grpc.max_receive_message_length': 1024*1024*1024,
      'grpc.enable_http_proxy': 1
   },
 );
 
+// utxo replies are still sent as a single message
 const utxoClient = new utxo_service.UtxoServiceClient(
   process.env.graphsearch_grpc_server_bind,
   grpc.credentials.createInsecure(),
@@ -40,20 +42,35 @@ app.get(/^\/slp\/graphsearch\/(.+)/, function(req, res) {
   const request = new graphsearch.GraphSearchRequest();
   request.setTxid(txid);
   
-  graphSearchClient.graphSearch(request, function(err, response) {
+  // the server searches first and then writes the result in batches
+  const txdatalist = [];
+  let failed = false;
+  const call = graphSearchClient.graphSearchStream(request);
+
+  call.on('data', function(response) {
+    for (const txdata of response.getTxdataList_asB64()) {
+      txdatalist.push(txdata);
+    }
+  });
+
+  call.on('error', function(err) {
+    failed = true;
+    console.log(err);
     res.setHeader('Content-Type', 'application/json');
-    if (err) {
-      console.log(err);
-      res.end(JSON.stringify({
-        success: false,
-        error:   err
-      }));
+    res.end(JSON.stringify({
+      success: false,
+      error:   err
+    }));
+  });
+
+  call.on('end', function() {
+    if (failed) {
       return;
     }
 
-    const txdatalist = response.getTxdataList_asB64();
     console.log(txid, txdatalist.length);
 
+    res.setHeader('Content-Type', 'application/json');
     res.end(JSON.stringify({
       success: true,
       data:    txdatalist
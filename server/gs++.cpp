@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <thread>
+#include <algorithm>
 #include <regex>
 #include <atomic>
 #include <chrono>
@@ -9,6 +10,7 @@
 #include <iterator>
 #include <cstdlib>
 #include <cstdint>
+#include <cmath>
 #include <csignal>
 
 #include <boost/thread.hpp>
@@ -27,6 +29,9 @@
 
 #include <gs++/bhash.hpp>
 #include <gs++/txgraph.hpp>
+#include <gs++/graph_search_cache.hpp>
+#include <gs++/txgraph_snapshot.hpp>
+#include <gs++/slp_validator_snapshot.hpp>
 #include <gs++/rpc.hpp>
 #include <gs++/bch.hpp>
 #include <gs++/graph_node.hpp>
@@ -68,17 +73,35 @@ std::atomic<bool> exit_early = { false };
 
 boost::shared_mutex processing_mutex;
 
+// outpoints spent by transactions in mg, used to find mempool conflicts of blocks
+// IMPORTANT: guard with processing_mutex
+absl::flat_hash_map<gs::outpoint, gs::txid> mempool_spends;
+
+// last block whose transactions are in g, snapshots are taken at it
+// IMPORTANT: guard with processing_mutex
+int           processed_block_height = -1;
+gs::blockhash processed_block_hash;
+
 std::atomic<bool> startup_processing_mempool = { true };
 std::vector<gs::transaction> startup_mempool_transactions; // TODO guard with mutex
 
 std::size_t max_exclusion_set_size = 5;
+std::size_t stream_batch_bytes = 1024*1024;
+std::size_t max_exclusion_filter_bytes = 1024*1024;
+const std::uint32_t max_exclusion_filter_hash_funcs = 50;
+std::size_t max_trusted_txids = 1000;
+std::size_t max_batch_txids = 100;
+std::size_t max_search_nodes = 0; // per request, 0 for no limit
+unsigned validation_threads = 1; // workers validating the tokens of a block
+std::size_t max_search_bytes = 0;
 std::array<uint8_t, 32> private_key;
 std::atomic<secp256k1_context*> ctx;
 boost::filesystem::path cache_dir;
 
 gs::slp_validator validator;
 gs::txgraph g;
-gs::txgraph mg; // mempool
+gs::txgraph mg(&g); // mempool
+gs::graph_search_cache graph_cache;
 gs::bch bch;
 
 const std::chrono::milliseconds await_time { 1000 };
@@ -131,6 +154,233 @@ void signal_handler(int signal)
     }
 }
 
+// mg is layered on top of g so a search starting in the mempool continues
+// into confirmed ancestors on its own, the seen set is shared between both
+gs::graph_search_status graph_search_layers(
+    const gs::txid& lookup_txid,
+    gs::graph_search_seen& seen,
+    const gs::graph_search_visitor& visitor,
+    const gs::graph_search_options& options,
+    bool& used_mempool
+) {
+    gs::graph_search_status status = mg.graph_search(lookup_txid, seen, visitor, options);
+
+    used_mempool = status == gs::graph_search_status::OK;
+
+    if (! used_mempool) { // txid not in mempool
+        status = g.graph_search(lookup_txid, seen, visitor, options);
+    }
+
+    return status;
+}
+
+// graph_search_layers for topological searches, result is left empty unless OK
+gs::graph_search_status graph_search_ordered_layers(
+    const gs::txid& lookup_txid,
+    gs::graph_search_seen& seen,
+    gs::graph_search_ordered_result& result,
+    const gs::graph_search_options& options
+) {
+    gs::graph_search_status status = mg.graph_search_ordered(lookup_txid, seen, result, options);
+
+    if (status != gs::graph_search_status::OK) { // txid not in mempool
+        status = g.graph_search_ordered(lookup_txid, seen, result, options);
+    }
+
+    return status;
+}
+
+// copies txdata[begin, end) of result into reply, parent indices stay relative
+// to the whole result while parent_offsets are rebased to this reply
+void graph_search_ordered_to_reply(
+    const gs::graph_search_ordered_result& result,
+    const std::size_t begin,
+    const std::size_t end,
+    graphsearch::GraphSearchReply* reply
+) {
+    const std::uint32_t parents_begin = result.parent_offsets[begin];
+
+    for (std::size_t i=begin; i<end; ++i) {
+        reply->add_txdata(result.txdata[i].first, result.txdata[i].second);
+        reply->add_parent_offsets(result.parent_offsets[i] - parents_begin);
+    }
+    reply->add_parent_offsets(result.parent_offsets[end] - parents_begin);
+
+    for (std::uint32_t i=parents_begin; i<result.parent_offsets[end]; ++i) {
+        reply->add_parents(result.parents[i]);
+    }
+}
+
+// the other way around, a search starting in g continues into mg on its own
+gs::graph_search_status descendant_search_layers(
+    const gs::txid& lookup_txid,
+    gs::graph_search_seen& seen,
+    const gs::graph_search_visitor& visitor,
+    const gs::graph_search_options& options
+) {
+    gs::graph_search_status status = g.descendant_search(lookup_txid, seen, visitor, options);
+
+    if (status != gs::graph_search_status::OK && ! seen.aborted()) { // txid not confirmed
+        status = mg.descendant_search(lookup_txid, seen, visitor, options);
+    }
+
+    return status;
+}
+
+// these take either a GraphSearchRequest or a GraphSearchBatchRequest
+
+// invalid txids are skipped and the list is cut off at max_exclusion_set_size
+template <typename Request>
+std::vector<gs::txid> graph_search_exclude_txids(const Request* request)
+{
+    std::vector<gs::txid> ret;
+    for (auto & txid_str : request->exclude_txids()) {
+        if (ret.size() >= max_exclusion_set_size) {
+            break;
+        }
+
+        if (std::regex_match(txid_str, txid_regex)) {
+            ret.emplace_back(txid_str);
+        }
+    }
+
+    return ret;
+}
+
+// the filter is left empty if the request does not carry one
+template <typename Request>
+grpc::Status graph_search_exclude_filter(
+    const Request* request,
+    gs::txid_filter& filter
+) {
+    if (request->exclude_filter().empty()) {
+        return { grpc::Status::OK };
+    }
+
+    if (request->exclude_filter().size() > max_exclusion_filter_bytes) {
+        return { grpc::StatusCode::INVALID_ARGUMENT, "exclude_filter too large" };
+    }
+
+    if (request->exclude_filter_hash_funcs() == 0
+     || request->exclude_filter_hash_funcs() > max_exclusion_filter_hash_funcs
+    ) {
+        return { grpc::StatusCode::INVALID_ARGUMENT, "exclude_filter_hash_funcs out of range" };
+    }
+
+    filter = gs::txid_filter(
+        std::vector<std::uint8_t>(request->exclude_filter().begin(), request->exclude_filter().end()),
+        request->exclude_filter_hash_funcs(),
+        request->exclude_filter_tweak()
+    );
+
+    return { grpc::Status::OK };
+}
+
+// context has to outlive options
+// searches give up once the client has gone away or its deadline has passed
+void graph_search_request_limits(
+    grpc::ServerContext* context,
+    gs::graph_search_options& options
+) {
+    options.max_nodes = max_search_nodes;
+    options.max_bytes = max_search_bytes;
+    options.cancelled = [context]() {
+        return context->IsCancelled()
+            || std::chrono::system_clock::now() > context->deadline();
+    };
+}
+
+// filter is pointed to by options so it has to outlive them, as does context
+template <typename Request>
+grpc::Status graph_search_request_options(
+    grpc::ServerContext* context,
+    const Request* request,
+    gs::txid_filter& filter,
+    gs::graph_search_options& options
+) {
+    graph_search_request_limits(context, options);
+
+    const grpc::Status filter_status = graph_search_exclude_filter(request, filter);
+    if (! filter_status.ok()) {
+        return filter_status;
+    }
+
+    if (! filter.empty()) {
+        options.exclude_filter = &filter;
+    }
+
+    options.trusted_height = request->trusted_height();
+
+    if (static_cast<std::size_t>(request->trusted_txids_size()) > max_trusted_txids) {
+        return { grpc::StatusCode::INVALID_ARGUMENT, "too many trusted_txids" };
+    }
+
+    return { grpc::Status::OK };
+}
+
+// returns false if any of the excluded txids could not be found
+template <typename Request>
+bool graph_search_request_seen(
+    const Request* request,
+    const std::vector<gs::txid>& exclude_txids,
+    const gs::graph_search_options& options,
+    gs::graph_search_seen& seen
+) {
+    bool complete = true;
+
+    for (const gs::txid & exclusion_txid : exclude_txids) {
+        if (seen.aborted()) { // the search which follows reports it
+            return false;
+        }
+
+        if (! g.build_exclusion_set(exclusion_txid, seen, options)) {
+            spdlog::info("build_exclusion_set missing {}", exclusion_txid.decompress(true));
+            complete = false;
+        }
+    }
+
+    // trusted checkpoints only cut the search off at themselves
+    for (auto & txid_str : request->trusted_txids()) {
+        if (! std::regex_match(txid_str, txid_regex)) {
+            continue;
+        }
+
+        const gs::txid trusted_txid(txid_str);
+        if (! g.mark_seen(trusted_txid, seen) && ! mg.mark_seen(trusted_txid, seen)) {
+            complete = false;
+        }
+    }
+
+    return complete;
+}
+
+grpc::Status graph_search_status_to_grpc(
+    const gs::graph_search_status status,
+    const std::string& lookup_txid_str
+) {
+    switch (status) {
+        case gs::graph_search_status::OK:
+            return { grpc::Status::OK };
+        case gs::graph_search_status::NOT_FOUND:
+            return { grpc::StatusCode::NOT_FOUND,
+                    "txid not found" };
+        case gs::graph_search_status::NOT_IN_TOKENGRAPH:
+            spdlog::error("graph_search: txid not found in tokengraph {}", lookup_txid_str);
+            return { grpc::StatusCode::INTERNAL,
+                    "txid found but not in tokengraph" };
+        case gs::graph_search_status::CANCELLED:
+            return { grpc::StatusCode::CANCELLED,
+                    "search cancelled" };
+        case gs::graph_search_status::LIMIT_EXCEEDED:
+            spdlog::warn("graph_search: limits exceeded {}", lookup_txid_str);
+            return { grpc::StatusCode::RESOURCE_EXHAUSTED,
+                    "search exceeded node or byte limit" };
+        default:
+            spdlog::error("unknown graph_search_status");
+            std::exit(EXIT_FAILURE);
+    }
+}
+
 class GraphSearchServiceImpl final
  : public graphsearch::GraphSearchService::Service
 {
@@ -143,6 +393,7 @@ class GraphSearchServiceImpl final
 
         gs::graph_search_status lookup_status;
         size_t lookup_count = 0;
+        bool cache_hit = false;
 
         std::string lookup_txid_str = "";
 
@@ -154,108 +405,340 @@ class GraphSearchServiceImpl final
             lookup_txid_str = lookup_txid.decompress(true);
 
 
-            std::vector<gs::txid> exclude_txids;
-            for (auto & txid_str : request->exclude_txids()) {
-                const bool rmatch = std::regex_match(txid_str, txid_regex);
-                if (rmatch) {
-                    exclude_txids.emplace_back(txid_str);
-                }
-            }
+            const std::vector<gs::txid> exclude_txids = graph_search_exclude_txids(request);
 
-            absl::flat_hash_set<const gs::graph_node*> exclusion_set;
+            gs::txid_filter exclude_filter;
+            gs::graph_search_options options;
+            const grpc::Status options_status = graph_search_request_options(context, request, exclude_filter, options);
+            if (! options_status.ok()) {
+                return options_status;
+            }
 
-            for (const gs::txid & exclusion_txid : exclude_txids) {
-                if (! g.build_exclusion_set(exclusion_txid, exclusion_set)) {
-                    spdlog::info("build_exclusion_set missing {}", exclusion_txid.decompress(true));
+            // filters and trust cutoffs are chosen per client so those replies are not worth caching
+            const bool cacheable = options.exclude_filter == nullptr
+                                && options.trusted_height == 0
+                                && request->trusted_txids_size() == 0
+                                && ! request->topological();
+
+            const std::uint64_t confirmed_epoch    = g.epoch;
+            const std::uint64_t mempool_generation = mg.generation;
+            std::shared_ptr<const gs::graph_search_cache::reply_txdata> cached_reply;
+
+            if (cacheable
+             && graph_cache.get(lookup_txid, exclude_txids, confirmed_epoch, mempool_generation, cached_reply)
+            ) {
+                for (const std::string & txdata : *cached_reply) {
+                    reply->add_txdata(txdata);
+                }
+                lookup_status = gs::graph_search_status::OK;
+                lookup_count  = cached_reply->size();
+                cache_hit     = true;
+            } else {
+                gs::graph_search_seen exclusion_set;
+                const bool exclusion_set_complete = graph_search_request_seen(request, exclude_txids, options, exclusion_set);
+
+                bool used_mempool = false;
+                if (request->topological()) {
+                    gs::graph_search_ordered_result result;
+                    lookup_status = graph_search_ordered_layers(lookup_txid, exclusion_set, result, options);
+                    if (lookup_status == gs::graph_search_status::OK) {
+                        graph_search_ordered_to_reply(result, 0, result.txdata.size(), reply);
+                        lookup_count = result.txdata.size();
+                    }
+                } else {
+                    // serialize straight from graph storage into the reply
+                    lookup_status = graph_search_layers(lookup_txid, exclusion_set,
+                        [&reply, &lookup_count](const std::uint8_t* txdata, const std::size_t size) {
+                            reply->add_txdata(txdata, size);
+                            ++lookup_count;
+                        },
+                        options,
+                        used_mempool
+                    );
                 }
 
-                if (exclude_txids.size() >= max_exclusion_set_size) {
-                    break;
+                // a missing exclusion may show up later and change the reply
+                if (lookup_status == gs::graph_search_status::OK
+                 && exclusion_set_complete
+                 && cacheable
+                 && graph_cache.max_bytes > 0
+                ) {
+                    std::size_t reply_bytes = 0;
+                    for (const std::string & txdata : reply->txdata()) {
+                        reply_bytes += txdata.size();
+                    }
+
+                    // replies too big for the cache are not copied just to be turned away
+                    if (reply_bytes <= graph_cache.max_bytes) {
+                        graph_cache.put(
+                            lookup_txid,
+                            exclude_txids,
+                            confirmed_epoch,
+                            used_mempool ? mempool_generation : gs::graph_search_cache::no_mempool,
+                            gs::graph_search_cache::reply_txdata(reply->txdata().begin(), reply->txdata().end())
+                        );
+                    }
                 }
             }
+        } else {
+            lookup_txid_str = std::string('*', 64);
+        }
 
-            // first check if referring to tx in mempool, this has special handling
-            gs::graph_search_response mempool_result = mg.graph_search__ptr(lookup_txid, exclusion_set);
-            lookup_status = mempool_result.first;
-            lookup_count = mempool_result.second.size();
+        const auto end = std::chrono::steady_clock::now();
+        const auto diff = end - start;
+        const auto diff_ms = std::chrono::duration<double, std::milli>(diff).count();
 
-            if (mempool_result.first == gs::graph_search_status::OK) {
+        spdlog::info("lookup: {} {} ({} ms){}", lookup_txid_str, lookup_count, diff_ms, cache_hit ? " cached" : "");
 
-                std::vector<gs::transaction> mempool_transactions;
-                mempool_transactions.reserve(mempool_result.second.size());
+        if (! rmatch) {
+            return { grpc::StatusCode::INVALID_ARGUMENT, "txid did not match regex" };
+        }
 
-                absl::flat_hash_set<gs::txid> mempool_txids;
+        return graph_search_status_to_grpc(lookup_status, lookup_txid_str);
+    }
 
-                for (const gs::graph_node & n : mempool_result.second) {
-                    for (auto & m : mempool_result.second) {
-                        reply->add_txdata(m.data(), m.size());
-                    }
+    grpc::Status GraphSearchStream (
+        grpc::ServerContext* context,
+        const graphsearch::GraphSearchRequest* request,
+        grpc::ServerWriter<graphsearch::GraphSearchReply>* writer
+    ) override {
+        const auto start = std::chrono::steady_clock::now();
 
-                    gs::transaction mtx;
-                    mtx.hydrate(n.txdata.begin(), n.txdata.end());
-                    mempool_transactions.push_back(mtx);
-                    mempool_txids.insert(mtx.txid);
-                }
+        // cowardly validating user provided data
+        if (! std::regex_match(request->txid(), txid_regex)) {
+            return { grpc::StatusCode::INVALID_ARGUMENT, "txid did not match regex" };
+        }
 
-                std::vector<gs::txid> unaccounted_mempool_txids;
+        const gs::txid lookup_txid(request->txid());
+        const std::string lookup_txid_str = lookup_txid.decompress(true);
 
-                for (const gs::transaction & mtx : mempool_transactions) {
-                    for (const gs::outpoint & o : mtx.inputs) {
-                        if (! mempool_txids.count(o.txid)) {
-                            unaccounted_mempool_txids.push_back(o.txid);
-                        }
-                    }
-                }
+        gs::txid_filter exclude_filter;
+        gs::graph_search_options options;
+        const grpc::Status options_status = graph_search_request_options(context, request, exclude_filter, options);
+        if (! options_status.ok()) {
+            return options_status;
+        }
 
-                absl::flat_hash_set<const gs::graph_node*> mempool_overlap_set;
-                for (const gs::txid & txid : unaccounted_mempool_txids) {
-                    gs::graph_search_response result = g.graph_search__ptr(lookup_txid, exclusion_set);
-                    g.build_exclusion_set(txid, mempool_overlap_set);
-                }
+        // batches are only cut once the search is done, nothing is written while
+        // a token is locked so a slow client can not hold up block processing
+        graphsearch::GraphSearchReply batch;
+        std::size_t batch_bytes  = 0;
+        std::size_t lookup_count = 0;
+        bool        write_ok     = true;
+
+        // txdata found by the search stays valid after the token locks are
+        // dropped, exclusion_set holds on to every token it walked
+        gs::graph_search_seen exclusion_set;
+        graph_search_request_seen(request, graph_search_exclude_txids(request), options, exclusion_set);
+
+        const auto flush = [&]() {
+            if (write_ok && batch.txdata_size() > 0) {
+                write_ok = writer->Write(batch);
+            }
+            batch.Clear();
+            batch_bytes = 0;
+        };
 
-                lookup_count += mempool_overlap_set.size();
-                for (const gs::graph_node* n: mempool_overlap_set) {
-                    reply->add_txdata(n->txdata.data(), n->txdata.size());
-                }
-            } else { // txid not in mempool
-                gs::graph_search_response result = g.graph_search__ptr(lookup_txid, exclusion_set);
-                lookup_status = result.first;
-                lookup_count = result.second.size();
-
-                if (lookup_status == gs::graph_search_status::OK) {
-                    for (const auto & m : result.second) {
-                        reply->add_txdata(m.data(), m.size());
+        gs::graph_search_status lookup_status;
+
+        if (request->topological()) {
+            gs::graph_search_ordered_result result;
+            lookup_status = graph_search_ordered_layers(lookup_txid, exclusion_set, result, options);
+
+            if (lookup_status == gs::graph_search_status::OK) {
+                std::size_t begin = 0;
+                for (std::size_t i=0; i<result.txdata.size() && write_ok; ++i) {
+                    batch_bytes += result.txdata[i].second;
+
+                    if (batch_bytes >= stream_batch_bytes || i+1 == result.txdata.size()) {
+                        graph_search_ordered_to_reply(result, begin, i+1, &batch);
+                        flush();
+                        begin = i+1;
                     }
                 }
+                lookup_count = result.txdata.size();
             }
         } else {
-            lookup_txid_str = std::string('*', 64);
+            std::vector<std::pair<const std::uint8_t*, std::size_t>> found;
+            bool used_mempool = false;
+            lookup_status = graph_search_layers(lookup_txid, exclusion_set,
+                [&found](const std::uint8_t* txdata, const std::size_t size) {
+                    found.emplace_back(txdata, size);
+                },
+                options,
+                used_mempool
+            );
+
+            if (lookup_status == gs::graph_search_status::OK) {
+                for (std::size_t i=0; i<found.size() && write_ok; ++i) {
+                    batch.add_txdata(found[i].first, found[i].second);
+                    batch_bytes += found[i].second;
+
+                    if (batch_bytes >= stream_batch_bytes || i+1 == found.size()) {
+                        flush();
+                    }
+                }
+                lookup_count = found.size();
+            }
         }
 
         const auto end = std::chrono::steady_clock::now();
         const auto diff = end - start;
         const auto diff_ms = std::chrono::duration<double, std::milli>(diff).count();
 
-        spdlog::info("lookup: {} {} ({} ms)", lookup_txid_str, lookup_count, diff_ms);
+        spdlog::info("lookup-stream: {} {} ({} ms)", lookup_txid_str, lookup_count, diff_ms);
 
-        if (! rmatch) {
+        if (! write_ok) {
+            return { grpc::StatusCode::CANCELLED, "stream closed by client" };
+        }
+
+        return graph_search_status_to_grpc(lookup_status, lookup_txid_str);
+    }
+
+    grpc::Status GraphSearchBatch (
+        grpc::ServerContext* context,
+        const graphsearch::GraphSearchBatchRequest* request,
+        graphsearch::GraphSearchBatchReply* reply
+    ) override {
+        const auto start = std::chrono::steady_clock::now();
+
+        if (static_cast<std::size_t>(request->txids_size()) > max_batch_txids) {
+            return { grpc::StatusCode::INVALID_ARGUMENT, "too many txids" };
+        }
+
+        // cowardly validating user provided data
+        std::vector<gs::txid> lookup_txids;
+        for (auto & txid_str : request->txids()) {
+            if (! std::regex_match(txid_str, txid_regex)) {
+                return { grpc::StatusCode::INVALID_ARGUMENT, "txid did not match regex" };
+            }
+
+            lookup_txids.emplace_back(txid_str);
+        }
+
+        gs::txid_filter exclude_filter;
+        gs::graph_search_options options;
+        const grpc::Status options_status = graph_search_request_options(context, request, exclude_filter, options);
+        if (! options_status.ok()) {
+            return options_status;
+        }
+
+        // one seen set for every lookup so shared ancestors are only walked and sent once
+        gs::graph_search_seen seen;
+        graph_search_request_seen(request, graph_search_exclude_txids(request), options, seen);
+
+        std::size_t lookup_count = 0;
+        const auto add_txdata = [&reply, &lookup_count](const std::uint8_t* txdata, const std::size_t size) {
+            reply->add_txdata(txdata, size);
+            ++lookup_count;
+        };
+
+        for (const gs::txid & lookup_txid : lookup_txids) {
+            bool used_mempool = false;
+            const gs::graph_search_status lookup_status = graph_search_layers(lookup_txid, seen, add_txdata, options, used_mempool);
+
+            if (lookup_status == gs::graph_search_status::NOT_FOUND) {
+                reply->add_not_found_txids(lookup_txid.decompress(true));
+            } else if (lookup_status != gs::graph_search_status::OK) {
+                return graph_search_status_to_grpc(lookup_status, lookup_txid.decompress(true));
+            }
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto diff = end - start;
+        const auto diff_ms = std::chrono::duration<double, std::milli>(diff).count();
+
+        spdlog::info("lookup-batch: {} {} ({} ms)", lookup_txids.size(), lookup_count, diff_ms);
+
+        return { grpc::Status::OK };
+    }
+
+    grpc::Status GraphSearchEstimate (
+        grpc::ServerContext* context,
+        const graphsearch::GraphSearchEstimateRequest* request,
+        graphsearch::GraphSearchEstimateReply* reply
+    ) override {
+        // cowardly validating user provided data
+        if (! std::regex_match(request->txid(), txid_regex)) {
+            return { grpc::StatusCode::INVALID_ARGUMENT, "txid did not match regex" };
+        }
+
+        const gs::txid lookup_txid(request->txid());
+
+        // the sketches already cover the parent layer, so only one layer is asked
+        gs::graph_search_estimate_result result;
+        gs::graph_search_status lookup_status = mg.graph_search_estimate(lookup_txid, result);
+        if (lookup_status != gs::graph_search_status::OK) { // txid not in mempool
+            lookup_status = g.graph_search_estimate(lookup_txid, result);
+        }
+
+        if (lookup_status == gs::graph_search_status::OK) {
+            reply->set_ancestor_count(static_cast<std::uint64_t>(std::llround(result.ancestors)));
+            reply->set_txdata_bytes(static_cast<std::uint64_t>(std::llround(result.bytes)));
+        }
+
+        return graph_search_status_to_grpc(lookup_status, lookup_txid.decompress(true));
+    }
+
+    grpc::Status DescendantSearch (
+        grpc::ServerContext* context,
+        const graphsearch::DescendantSearchRequest* request,
+        graphsearch::DescendantSearchReply* reply
+    ) override {
+        const auto start = std::chrono::steady_clock::now();
+
+        // cowardly validating user provided data
+        if (! std::regex_match(request->txid(), txid_regex)) {
             return { grpc::StatusCode::INVALID_ARGUMENT, "txid did not match regex" };
         }
 
-        switch (lookup_status) {
-            case gs::graph_search_status::OK:
-                return { grpc::Status::OK };
-            case gs::graph_search_status::NOT_FOUND:
-                return { grpc::StatusCode::NOT_FOUND,
-                        "txid not found" };
-            case gs::graph_search_status::NOT_IN_TOKENGRAPH:
-                spdlog::error("graph_search__ptr: txid not found in tokengraph {}", lookup_txid_str);
-                return { grpc::StatusCode::INTERNAL,
-                        "txid found but not in tokengraph" };
-            default:
-                spdlog::error("unknown graph_search_status");
-                std::exit(EXIT_FAILURE);
+        const gs::txid lookup_txid(request->txid());
+        const std::string lookup_txid_str = lookup_txid.decompress(true);
+
+        gs::graph_search_options options;
+        graph_search_request_limits(context, options);
+
+        gs::graph_search_seen seen;
+        std::size_t lookup_count = 0;
+        const gs::graph_search_status lookup_status = descendant_search_layers(lookup_txid, seen,
+            [&reply, &lookup_count](const std::uint8_t* txdata, const std::size_t size) {
+                reply->add_txdata(txdata, size);
+                ++lookup_count;
+            },
+            options
+        );
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto diff = end - start;
+        const auto diff_ms = std::chrono::duration<double, std::milli>(diff).count();
+
+        spdlog::info("descendants: {} {} ({} ms)", lookup_txid_str, lookup_count, diff_ms);
+
+        return graph_search_status_to_grpc(lookup_status, lookup_txid_str);
+    }
+
+    grpc::Status OutputSpender (
+        grpc::ServerContext* context,
+        const graphsearch::OutputSpenderRequest* request,
+        graphsearch::OutputSpenderReply* reply
+    ) override {
+        // cowardly validating user provided data
+        if (! std::regex_match(request->txid(), txid_regex)) {
+            return { grpc::StatusCode::INVALID_ARGUMENT, "txid did not match regex" };
         }
+
+        const gs::outpoint outpoint(gs::txid(request->txid()), request->vout());
+
+        gs::txid spender;
+        if (! g.find_spender(outpoint, spender) && ! mg.find_spender(outpoint, spender)) {
+            return { grpc::StatusCode::NOT_FOUND, "outpoint not spent in tokengraph" };
+        }
+
+        reply->set_spender_txid(spender.decompress(true));
+
+        spdlog::info("spender: {}:{} {}", outpoint.txid.decompress(true), outpoint.vout, reply->spender_txid());
+
+        return { grpc::Status::OK };
     }
 
     grpc::Status TrustedValidation (
@@ -273,6 +756,7 @@ class GraphSearchServiceImpl final
         if (rmatch) {
             const gs::txid lookup_txid(request->txid());
             lookup_txid_str = lookup_txid.decompress(true);
+            boost::shared_lock<boost::shared_mutex> validator_lock(processing_mutex);
             const bool valid_tx = validator.has_valid(lookup_txid);
             reply->set_valid(valid_tx);
         }
@@ -311,6 +795,7 @@ class GraphSearchServiceImpl final
         }
 
         if (rmatch) {
+            boost::shared_lock<boost::shared_mutex> validator_lock(processing_mutex);
             for (auto & lookup_txid : lookup_txids) {
                 const bool valid_tx = validator.has_valid(lookup_txid);
                 graphsearch::TrustedValidationReply* el = reply->add_valid();
@@ -345,19 +830,25 @@ class GraphSearchServiceImpl final
         static const std::regex txid_regex("^[0-9a-fA-F]{64}$");
         const bool rmatch = std::regex_match(request->txid(), txid_regex);
         bool valid_tx = false;
-        gs::transaction tx;
         if (rmatch) {
             const gs::txid lookup_txid(request->txid());
             lookup_txid_str = lookup_txid.decompress(true);
-            valid_tx = validator.has_valid(lookup_txid);
+            // tx_ptr and txdata point into the validator, which blocks may change
+            boost::shared_lock<boost::shared_mutex> validator_lock(processing_mutex);
+            const gs::slp_record* tx_ptr = validator.find(lookup_txid);
+            valid_tx = tx_ptr != nullptr && validator.has_valid(lookup_txid);
             if (valid_tx) {
-                gs::transaction tx = validator.get(lookup_txid);
+                const gs::slp_record & tx = *tx_ptr;
                 lookup_vout = request->vout();
 
+                const std::uint8_t* txdata = nullptr;
+                std::size_t txdata_size = 0;
+                validator.txdata(lookup_txid, txdata, txdata_size);
+
                 const gs::txid    txid      = lookup_txid;
                 const uint32_t    vout      = lookup_vout;
-                const gs::tokenid tokenid   = tx.slp.tokenid;
-                const uint16_t    tokentype = tx.slp.token_type;
+                const gs::tokenid tokenid   = tx.tokenid;
+                const uint16_t    tokentype = tx.token_type;
                 const uint64_t    value     = tx.output_slp_amount(vout);
 
                 std::vector<uint8_t> preimage;
@@ -368,10 +859,10 @@ class GraphSearchServiceImpl final
                     std::memcpy(preimage.data()+36, tokenid.data(), 32);
                     std::memcpy(preimage.data()+68, &tokentype,      2);
                     std::memcpy(preimage.data()+70, &value,          8);
-                    const uint8_t is_baton = tx.mint_baton_outpoint().vout == vout;
+                    const uint8_t is_baton = tx.mint_baton_vout == vout;
                     std::memcpy(preimage.data()+78, &is_baton,       1);
                     // TODO debug, maybe remove in later release
-                    reply->set_tx(tx.serialized.data(), tx.serialized.size());
+                    reply->set_tx(txdata, txdata_size);
                     reply->set_vout(vout);
                     reply->set_tokenid(tokenid.data(), tokenid.size());
                     reply->set_tokentype(tokentype);
@@ -384,10 +875,10 @@ class GraphSearchServiceImpl final
                     std::memcpy(preimage.data()+36, tokenid.data(), 32);
                     std::memcpy(preimage.data()+68, &tokentype,      2);
                     std::memcpy(preimage.data()+70, &value,          8);
-                    const uint8_t is_baton = tx.mint_baton_outpoint().vout == vout;
+                    const uint8_t is_baton = tx.mint_baton_vout == vout;
                     std::memcpy(preimage.data()+78, &is_baton,  1);
                     // TODO debug, maybe remove in later release
-                    reply->set_tx(tx.serialized.data(), tx.serialized.size());
+                    reply->set_tx(txdata, txdata_size);
                     reply->set_vout(vout);
                     reply->set_tokenid(tokenid.data(), tokenid.size());
                     reply->set_tokentype(tokentype);
@@ -400,13 +891,16 @@ class GraphSearchServiceImpl final
                     std::memcpy(preimage.data()+36, tokenid.data(), 32);
                     std::memcpy(preimage.data()+68, &tokentype,      2);
                     // TODO UNTESTED
-                    const gs::transaction gen_tx   = validator.get(gs::txid(tokenid.v));
                     const gs::outpoint& i_outpoint = tx.inputs[0];
-                    const gs::transaction & txi    = validator.transaction_map.at(i_outpoint.txid);
-                    const gs::tokenid group_id     = txi.slp.tokenid;
+                    const gs::slp_record* txi      = validator.find(i_outpoint.txid);
+                    if (txi == nullptr) {
+                        spdlog::error("outputoracle: group genesis input not found {}", i_outpoint.txid.decompress(true));
+                        return { grpc::StatusCode::INTERNAL, "group genesis input not found" };
+                    }
+                    const gs::tokenid group_id     = txi->tokenid;
                     std::memcpy(preimage.data()+70, &group_id,  32);
                     // TODO debug, maybe remove in later release
-                    reply->set_tx(tx.serialized.data(), tx.serialized.size());
+                    reply->set_tx(txdata, txdata_size);
                     reply->set_vout(vout);
                     reply->set_tokenid(tokenid.data(), tokenid.size());
                     reply->set_tokentype(tokentype);
@@ -463,9 +957,41 @@ class GraphSearchServiceImpl final
         reply->set_last_incoming_zmq_blk_size(last_incoming_zmq_blk_size);
         reply->set_last_outgoing_zmq_blk_size(last_outgoing_zmq_blk_size);
 
+        const gs::slp_validation_report report = validator.stats.report();
+        set_validation_histogram(report.nanoseconds, reply->mutable_validation_nanoseconds());
+        set_validation_histogram(report.inputs,      reply->mutable_validation_inputs());
+        set_validation_histogram(report.lookups,     reply->mutable_validation_lookups());
+
+        for (const gs::slp_slow_validation & slow : report.slowest) {
+            graphsearch::SlowValidation* v = reply->add_slowest_validations();
+            v->set_txid(slow.txid.decompress(true));
+            v->set_tokenid(slow.tokenid.decompress(true));
+            v->set_nanoseconds(slow.cost.nanoseconds);
+            v->set_inputs(slow.cost.inputs);
+            v->set_lookups(slow.cost.lookups);
+        }
+
         return { grpc::Status::OK };
     }
 
+    static void set_validation_histogram(
+        const gs::slp_validation_histogram& histogram,
+        graphsearch::ValidationHistogram* reply
+    ) {
+        unsigned num_buckets = histogram.buckets.size();
+        while (num_buckets > 0 && histogram.buckets[num_buckets-1] == 0) {
+            --num_buckets;
+        }
+
+        for (unsigned i=0; i<num_buckets; ++i) {
+            reply->add_buckets(histogram.buckets[i]);
+        }
+
+        reply->set_count(histogram.count);
+        reply->set_sum(histogram.sum);
+        reply->set_max(histogram.max);
+    }
+
     grpc::Status SlpOutpoints(
         grpc::ServerContext* context,
         const graphsearch::SlpOutpointsRequest* request,
@@ -513,21 +1039,39 @@ class GraphSearchServiceImpl final
 
         std::vector<gs::output> allUtxos = bch.utxodb.get_outputs_by_scriptpubkey(scriptpubkey, 1e5);
 
-        for (gs::output utxo : allUtxos) {
-            gs::transaction tx = validator.get(utxo.prev_tx_id);
-            gs::transaction genesis_tx = validator.get(gs::txid(tx.slp.tokenid.v));
+        // genesis metadata is parsed from txdata, once per token
+        absl::flat_hash_map<gs::tokenid, gs::transaction> genesis_txs;
+
+        for (const gs::output & utxo : allUtxos) {
+            const gs::slp_record* tx_ptr = validator.find(utxo.prev_tx_id);
+            if (tx_ptr == nullptr) {
+                continue;
+            }
+
+            const gs::slp_record & tx = *tx_ptr;
+            auto genesis_search = genesis_txs.find(tx.tokenid);
+            if (genesis_search == genesis_txs.end()) {
+                gs::transaction genesis_tx;
+                if (! validator.get(gs::txid(tx.tokenid.v), genesis_tx)) {
+                    continue;
+                }
+
+                genesis_search = genesis_txs.insert({ tx.tokenid, std::move(genesis_tx) }).first;
+            }
+
+            const gs::transaction & genesis_tx = genesis_search->second;
             const gs::slp_transaction_genesis & genesis_info = absl::get<gs::slp_transaction_genesis>(genesis_tx.slp.slp_tx);
 
             graphsearch::SlpUtxo* el = reply->add_utxos();
             el->set_txid(utxo.prev_tx_id.decompress(true));
             el->set_vout(utxo.prev_out_idx);
-            el->set_satoshis(tx.outputs[utxo.prev_out_idx].value);
+            el->set_satoshis(utxo.value);
             el->set_value(tx.output_slp_amount(utxo.prev_out_idx));
             el->set_decimals(genesis_info.decimals);
             el->set_ticker(genesis_info.ticker);
             el->set_tokenid(genesis_tx.txid.decompress(true));
-            el->set_type(tx.slp.token_type);
-            el->set_isbaton(tx.mint_baton_outpoint().vout == utxo.prev_out_idx);
+            el->set_type(tx.token_type);
+            el->set_isbaton(tx.mint_baton_vout == utxo.prev_out_idx);
         }
 
         const auto end = std::chrono::steady_clock::now();
@@ -556,11 +1100,11 @@ class GraphSearchServiceImpl final
         boost::lock_guard<boost::shared_mutex> validator_lock(processing_mutex);
 
         const gs::txid txid(tokenid.v);
-        if (!validator.has(txid)) {
+        gs::transaction genesis_tx;
+        if (! validator.get(txid, genesis_tx)) {
             return { grpc::StatusCode::NOT_FOUND, "token " + request->tokenid() + " not found" };
         }
 
-        gs::transaction genesis_tx = validator.get(txid);
         const gs::slp_transaction_genesis & genesis_info = absl::get<gs::slp_transaction_genesis>(genesis_tx.slp.slp_tx);
 
         reply->set_name(genesis_info.name);
@@ -573,8 +1117,8 @@ class GraphSearchServiceImpl final
         reply->set_documenturl(genesis_info.document_uri);
         reply->set_type(genesis_tx.slp.token_type);
         if (genesis_tx.slp.token_type == 0x41) {
-            const gs::transaction & txi    = validator.transaction_map.at(genesis_tx.inputs[0].txid);
-            const gs::tokenid group_id     = txi.slp.tokenid;
+            const gs::slp_record & txi     = validator.records.at(genesis_tx.inputs[0].txid);
+            const gs::tokenid group_id     = txi.tokenid;
 
             reply->set_groupid(group_id.decompress(true));
         }
@@ -614,20 +1158,20 @@ class GraphSearchServiceImpl final
 
         std::uint64_t balance = 0;
 
-        for (gs::output utxo : allUtxos) {
-            gs::transaction tx = validator.get(utxo.prev_tx_id);
-            if (tx.slp.tokenid != tokenid) {
+        for (const gs::output & utxo : allUtxos) {
+            const gs::slp_record* tx = validator.find(utxo.prev_tx_id);
+            if (tx == nullptr || tx->tokenid != tokenid) {
                 continue;
             }
 
-            balance += tx.output_slp_amount(utxo.prev_out_idx);
+            balance += tx->output_slp_amount(utxo.prev_out_idx);
         }
 
-        if (balance == 0) {
+        gs::transaction genesis_tx;
+        if (balance == 0 || ! validator.get(gs::txid(tokenid.v), genesis_tx)) {
             reply->set_value(0);
             reply->set_tokenid(request->tokenid());
         } else {
-            gs::transaction genesis_tx = validator.get(gs::txid(tokenid.v));
             const gs::slp_transaction_genesis & genesis_info = absl::get<gs::slp_transaction_genesis>(genesis_tx.slp.slp_tx);
 
             reply->set_value(balance);
@@ -665,14 +1209,21 @@ class GraphSearchServiceImpl final
 
         absl::flat_hash_map<gs::tokenid, std::uint64_t> balances;
 
-        for (gs::output utxo : allUtxos) {
-            gs::transaction tx = validator.get(utxo.prev_tx_id);
+        for (const gs::output & utxo : allUtxos) {
+            const gs::slp_record* tx = validator.find(utxo.prev_tx_id);
+            if (tx == nullptr) {
+                continue;
+            }
 
-            balances[tx.slp.tokenid] += tx.output_slp_amount(utxo.prev_out_idx);
+            balances[tx->tokenid] += tx->output_slp_amount(utxo.prev_out_idx);
         }
 
         for (const auto & pair : balances) {
-            gs::transaction genesis_tx = validator.get(gs::txid(pair.first.v));
+            gs::transaction genesis_tx;
+            if (! validator.get(gs::txid(pair.first.v), genesis_tx)) {
+                continue;
+            }
+
             const gs::slp_transaction_genesis & genesis_info = absl::get<gs::slp_transaction_genesis>(genesis_tx.slp.slp_tx);
 
             graphsearch::SlpTokenBalanceReply* el = reply->add_balances();
@@ -775,6 +1326,66 @@ class UtxoServiceImpl final
     }
 };
 
+void mempool_add_spends(const gs::transaction& tx)
+{
+    for (const gs::outpoint & input : tx.inputs) {
+        mempool_spends[input] = tx.txid;
+    }
+}
+
+void mempool_remove_spends(const gs::txid& txid, const std::vector<gs::outpoint>& inputs)
+{
+    for (const gs::outpoint & input : inputs) {
+        const auto it = mempool_spends.find(input);
+        if (it != mempool_spends.end() && it->second == txid) {
+            mempool_spends.erase(it);
+        }
+    }
+}
+
+// mempool transactions double spent by the block along with all of their
+// mempool descendants, these are dropped from mg and the validator
+std::vector<gs::txid> mempool_evict_conflicts(const gs::block& block)
+{
+    absl::flat_hash_set<gs::txid> evicted;
+
+    for (const auto & tx : block.txs) {
+        for (const gs::outpoint & input : tx.inputs) {
+            const auto it = mempool_spends.find(input);
+            if (it != mempool_spends.end() && it->second != tx.txid) {
+                evicted.insert(it->second);
+            }
+        }
+    }
+
+    if (evicted.empty()) {
+        return {};
+    }
+
+    for (bool grew = true; grew; ) {
+        grew = false;
+        for (const auto & m : mempool_spends) {
+            if (evicted.count(m.first.txid) && evicted.insert(m.second).second) {
+                grew = true;
+            }
+        }
+    }
+
+    std::vector<gs::txid> ret;
+    for (const gs::txid & txid : evicted) {
+        const gs::slp_record* record = validator.find(txid);
+        if (record) {
+            mempool_remove_spends(txid, record->inputs);
+            validator.remove_tx(txid);
+        }
+
+        spdlog::info("evicting conflicted mempool tx {}", txid.decompress(true));
+        ret.push_back(txid);
+    }
+
+    return ret;
+}
+
 bool slpsync_bitcoind_process_block(const gs::block& block, const bool mempool, const bool trusted, std::vector<gs::transaction> * valid_txs_list = nullptr)
 {
     boost::lock_guard<boost::shared_mutex> lock(processing_mutex);
@@ -783,32 +1394,65 @@ bool slpsync_bitcoind_process_block(const gs::block& block, const bool mempool,
         bch.process_block(block, true);
     }
 
-    absl::flat_hash_map<gs::tokenid, std::vector<gs::transaction>> valid_txs;
+    // confirmed mempool transactions move from mg to g
+    std::vector<gs::txid> mempool_removed;
+
+    // known ones were validated when they entered the mempool
+    std::vector<const gs::transaction*> pending;
     for (auto & tx : block.txs) {
-        if (validator.has(tx.txid)) {
-            // skip over ones we've already added from mempool // TODO correct doc?
-            continue;
-        }
-        if (! validator.add_tx(tx, trusted)) {
-            std::cerr << "invalid tx: " << tx.txid.decompress(true) << std::endl;
-            continue;
+        if (! validator.has(tx.txid)) {
+            pending.push_back(&tx);
         }
+    }
 
-        if (! valid_txs.count(tx.slp.tokenid)) {
-            valid_txs.insert({ tx.slp.tokenid, { tx } });
+    const std::vector<bool> added = validator.add_txs(pending, trusted, validation_threads);
+
+    // tokens go into g in order of first appearance so every run builds the same graph
+    std::vector<gs::tokenid> token_order;
+    absl::flat_hash_map<gs::tokenid, std::vector<gs::transaction>> valid_txs;
+    std::size_t pending_idx = 0;
+    for (auto & tx : block.txs) {
+        if (pending_idx < pending.size() && pending[pending_idx] == &tx) {
+            if (! added[pending_idx++]) {
+                std::cerr << "invalid tx: " << tx.txid.decompress(true) << std::endl;
+                continue;
+            }
+
+            if (valid_txs_list) {
+                valid_txs_list->push_back(tx);
+            }
         } else {
-            valid_txs[tx.slp.tokenid].push_back(tx);
+            if (! mg.find_token(tx.txid)) {
+                continue;
+            }
+
+            mempool_remove_spends(tx.txid, tx.inputs);
+            mempool_removed.push_back(tx.txid);
         }
 
-        if (valid_txs_list) {
-            valid_txs_list->push_back(tx);
+        std::vector<gs::transaction> & token_txs = valid_txs[tx.slp.tokenid];
+        if (token_txs.empty()) {
+            token_order.push_back(tx.slp.tokenid);
         }
+        token_txs.push_back(tx);
     }
 
-    for (auto & m : valid_txs) {
-        g.insert_token_data(m.first, m.second);
+    for (const gs::tokenid & tokenid : token_order) {
+        g.insert_token_data(tokenid, valid_txs[tokenid], current_block_height);
     }
 
+    if (! mempool_spends.empty()) {
+        const std::vector<gs::txid> conflicts = mempool_evict_conflicts(block);
+        mempool_removed.insert(mempool_removed.end(), conflicts.begin(), conflicts.end());
+    }
+
+    if (! mempool_removed.empty()) {
+        mg.remove_token_data(mempool_removed);
+    }
+
+    processed_block_height = current_block_height;
+    processed_block_hash   = block.block_hash;
+
     spdlog::info("processed block {} ({}) [{}/{}]", current_block_height, validator.valid.size(), valid_txs.size(), block.txs.size());
 
     return true;
@@ -818,6 +1462,7 @@ bool slpsync_bitcoind_process_mempool(const gs::block& block)
 {
     boost::lock_guard<boost::shared_mutex> lock(processing_mutex);
     mg.clear();
+    mempool_spends.clear();
 
     absl::flat_hash_map<gs::tokenid, std::vector<gs::transaction>> valid_txs;
     for (auto & tx : block.txs) {
@@ -839,6 +1484,10 @@ bool slpsync_bitcoind_process_mempool(const gs::block& block)
 
     for (auto & m : valid_txs) {
         mg.insert_token_data(m.first, m.second);
+
+        for (const auto & tx : m.second) {
+            mempool_add_spends(tx);
+        }
     }
 
     if (utxosync) {
@@ -880,10 +1529,111 @@ bool slpsync_bitcoind_process_tx(const gs::transaction& tx)
     }
 
     mg.insert_token_data(tx.slp.tokenid, { tx });
+    mempool_add_spends(tx);
 
     return true;
 }
 
+// restores g and the validator from a snapshot instead of replaying every block before it
+// the validator comes from its own checkpoint when one was taken at the same block,
+// otherwise transactions are rehydrated from the graph txdata, on success blocks resume at height+1
+bool slpsync_load_snapshot(const std::string& path, const std::string& checkpoint_path)
+{
+    boost::lock_guard<boost::shared_mutex> lock(processing_mutex);
+
+    gs::slp_validator_snapshot checkpoint;
+    bool warm = ! checkpoint_path.empty() && checkpoint.load(checkpoint_path, validator);
+
+    absl::flat_hash_set<gs::txid> valid;
+    gs::txgraph_snapshot snapshot;
+    if (! snapshot.load(path, g, valid)) {
+        validator.clear();
+        return false;
+    }
+
+    if (warm && (checkpoint.height != snapshot.height || checkpoint.block_hash != snapshot.block_hash)) {
+        spdlog::warn("snapshot: checkpoint is at height {} but the graph is at {}, rehydrating", checkpoint.height, snapshot.height);
+        validator.clear();
+        warm = false;
+    }
+
+    bool hydrated = true;
+    if (! warm) {
+        validator.valid = std::move(valid);
+
+        boost::shared_lock<boost::shared_mutex> lookup_lock(g.lookup_mtx);
+        validator.records.reserve(g.txid_to_token.size());
+
+        for (const auto & it : g.tokens) {
+            if (! hydrated) {
+                break;
+            }
+
+            const gs::token_details& token = *it.second;
+            for (std::size_t i=0; i<token.size(); ++i) {
+                gs::transaction tx;
+                const std::uint8_t* txdata = token.txdata_begin(i);
+                if (! tx.hydrate(txdata, txdata + token.txdata_size(i))) {
+                    spdlog::error("snapshot: failed to hydrate {}", token.txids[i].decompress(true));
+                    hydrated = false;
+                    break;
+                }
+
+                // bytes are shared with g through the store, only the record is new
+                validator.add_tx(tx, true);
+            }
+        }
+    }
+
+    if (! hydrated) {
+        g.clear();
+        validator.clear();
+        return false;
+    }
+
+    current_block_height = snapshot.height + 1;
+    current_block_hash = snapshot.block_hash;
+    processed_block_height = snapshot.height;
+    processed_block_hash   = snapshot.block_hash;
+
+    spdlog::info("snapshot: restored {} transactions at height {}", validator.records.size(), snapshot.height);
+
+    return true;
+}
+
+// either path may be empty to skip that image, both are taken at the same block
+bool slpsync_save_snapshot(const std::string& path, const std::string& checkpoint_path)
+{
+    boost::shared_lock<boost::shared_mutex> lock(processing_mutex);
+
+    if (processed_block_height < 0) {
+        spdlog::warn("snapshot: no block processed yet, not saving");
+        return false;
+    }
+
+    bool saved = true;
+    if (! path.empty()) {
+        gs::txgraph_snapshot snapshot;
+        snapshot.height = processed_block_height;
+        snapshot.block_hash = processed_block_hash;
+
+        saved = snapshot.save(path, g, validator.valid) && saved;
+    }
+
+    if (! checkpoint_path.empty()) {
+        gs::slp_validator_snapshot checkpoint;
+        checkpoint.height = processed_block_height;
+        checkpoint.block_hash = processed_block_hash;
+
+        // the mempool is left out, it is validated again when it is synced on start
+        saved = checkpoint.save(checkpoint_path, validator, [](const gs::txid& txid) {
+            return g.find_token(txid) != nullptr;
+        }) && saved;
+    }
+
+    return saved;
+}
+
 boost::filesystem::path block_height_to_path(const std::uint32_t height)
 {
     return cache_dir / "slp" / std::to_string(height / 1000);
@@ -954,6 +1704,17 @@ int main(int argc, char * argv[])
         cache_dir = boost::filesystem::path(toml::find<std::string>(config, "cache", "dir"));
     }
     max_exclusion_set_size = toml::find<std::size_t>(config, "graphsearch", "max_exclusion_set_size");
+    graph_cache.max_bytes = toml::find<std::size_t>(config, "graphsearch", "reply_cache_max_bytes");
+    stream_batch_bytes = toml::find<std::size_t>(config, "graphsearch", "stream_batch_bytes");
+    max_exclusion_filter_bytes = toml::find<std::size_t>(config, "graphsearch", "max_exclusion_filter_bytes");
+    max_trusted_txids = toml::find<std::size_t>(config, "graphsearch", "max_trusted_txids");
+    max_batch_txids = toml::find<std::size_t>(config, "graphsearch", "max_batch_txids");
+    max_search_nodes = toml::find<std::size_t>(config, "graphsearch", "max_search_nodes");
+    max_search_bytes = toml::find<std::size_t>(config, "graphsearch", "max_search_bytes");
+    validation_threads = toml::find<unsigned>(config, "graphsearch", "validation_threads");
+    if (validation_threads == 0) {
+        validation_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
     {
         const std::vector<uint8_t> privkey = gs::util::unhex(
             toml::find<std::string>(config, "graphsearch", "private_key")
@@ -985,7 +1746,35 @@ int main(int argc, char * argv[])
         current_block_height= toml::find<int>(config, "utxo", "block_height");
     }
 
+    const std::string snapshot_path = toml::find<std::string>(config, "graphsearch", "snapshot_path");
+    const bool snapshot_save = toml::find<bool>(config, "graphsearch", "snapshot_save");
+    const std::string checkpoint_path = toml::find<std::string>(config, "utxo", "checkpoint_path");
+    const bool checkpoint_save = toml::find<bool>(config, "utxo", "checkpoint_save");
+
+    // blocks between saves while following zmq, 0 to only save after syncing and at shutdown
+    const std::uint32_t snapshot_interval = toml::find<std::uint32_t>(config, "graphsearch", "snapshot_interval");
+    const auto save_snapshots = [&]() {
+        if (snapshot_save || checkpoint_save) {
+            slpsync_save_snapshot(
+                snapshot_save   ? snapshot_path   : "",
+                checkpoint_save ? checkpoint_path : ""
+            );
+        }
+    };
+
     if (toml::find<bool>(config, "services", "graphsearch")) {
+        if (toml::find<bool>(config, "graphsearch", "snapshot_load")) {
+            // the utxo db is built from every block so it cannot start from a snapshot
+            if (utxosync) {
+                spdlog::warn("snapshot: not loading while utxosync is enabled");
+            } else if (! slpsync_load_snapshot(
+                snapshot_path,
+                toml::find<bool>(config, "utxo", "checkpoint_load") ? checkpoint_path : ""
+            )) {
+                spdlog::warn("snapshot: could not load {}, replaying all blocks", snapshot_path);
+            }
+        }
+
         if (cache_enabled) {
             for (; ! exit_early; ++current_block_height) {
                 boost::filesystem::path blk_path = block_height_to_path(current_block_height) / std::to_string(current_block_height);
@@ -1098,6 +1887,10 @@ int main(int argc, char * argv[])
                 break;
             }
         }
+
+        if (! exit_early) {
+            save_snapshots();
+        }
     }
 
     std::thread zmq_listener([&] {
@@ -1171,7 +1964,12 @@ int main(int argc, char * argv[])
                             if (zmqpub) {
                                 spdlog::info("publishing zmq tx {}", tx.txid.decompress(true));
 
-                                const auto & genesis_tx = validator.get(gs::txid(tx.slp.tokenid.v));
+                                gs::transaction genesis_tx;
+                                if (! validator.get(gs::txid(tx.slp.tokenid.v), genesis_tx)) {
+                                    spdlog::warn("zmq-tx genesis not found {}", tx.slp.tokenid.decompress(true));
+                                    continue;
+                                }
+
                                 const gs::slp_transaction_genesis & genesis_info = absl::get<gs::slp_transaction_genesis>(genesis_tx.slp.slp_tx);
 
                                 nlohmann::json json{{"inputs", nlohmann::json::array()}, {"outputs", nlohmann::json::array()}};
@@ -1179,13 +1977,19 @@ int main(int argc, char * argv[])
                                     boost::lock_guard<boost::shared_mutex> lock(bch.lookup_mtx);
 
                                     if (tx.slp.token_type == 0x41) {
-                                        const auto & txi = validator.get(genesis_tx.inputs[0].txid);
-                                        json["groupId"] = txi.slp.tokenid.decompress(true);
+                                        const gs::slp_record* txi = validator.find(genesis_tx.inputs[0].txid);
+                                        if (txi != nullptr) {
+                                            json["groupId"] = txi->tokenid.decompress(true);
+                                        } else {
+                                            spdlog::warn("zmq-tx group genesis input not found {}", genesis_tx.inputs[0].txid.decompress(true));
+                                        }
                                     }
 
                                     for (const auto & input : tx.slp_inputs(validator)) {
-                                        const auto & prevTx = validator.get(input.txid);
-                                        json["inputs"].push_back(prevTx.outputs[input.vout].scriptpubkey.to_cashaddr(networkPrefix));
+                                        gs::transaction prevTx;
+                                        if (validator.get(input.txid, prevTx)) {
+                                            json["inputs"].push_back(prevTx.outputs[input.vout].scriptpubkey.to_cashaddr(networkPrefix));
+                                        }
                                     }
                                 }
 
@@ -1235,21 +2039,20 @@ int main(int argc, char * argv[])
 
                             block.topological_sort();
 
+                            // also moves confirmed transactions out of mg and evicts conflicts
                             ++current_block_height;
                             if (! slpsync_bitcoind_process_block(block, false, false)) {
                                 spdlog::error("failed to process zmq block {}", current_block_height);
                                 --current_block_height;
                                 continue;
                             }
-                            std::vector<gs::transaction> mempool_transactions = get_mempool_transactions(rpc);
-                            gs::block mempool_block;
-                            mempool_block.txs = mempool_transactions;
-                            mempool_block.topological_sort();
-                            slpsync_bitcoind_process_mempool(mempool_block);
-
 
                             current_block_hash = block.block_hash;
 
+                            if (snapshot_interval > 0 && current_block_height % snapshot_interval == 0) {
+                                save_snapshots();
+                            }
+
                             if (zmqpub) {
                                 spdlog::info("publishing zmq block {}", block.merkle_root.decompress(true));
 
@@ -1326,6 +2129,9 @@ retry_loop1:
 
     zmq_listener.join();
 
+    // blocks since the last save do not have to be replayed on the next start
+    save_snapshots();
+
     spdlog::info("goodbye");
 
     return EXIT_SUCCESS;
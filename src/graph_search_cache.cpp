@@ -0,0 +1,132 @@
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <utility>
+
+#include <gs++/bhash.hpp>
+#include <gs++/graph_search_cache.hpp>
+
+namespace gs {
+
+constexpr std::uint64_t graph_search_cache::no_mempool;
+
+std::uint64_t graph_search_cache::fingerprint(std::vector<gs::txid>& exclude_txids)
+{
+    std::sort(exclude_txids.begin(), exclude_txids.end(), [](const gs::txid& a, const gs::txid& b) {
+        return a.v < b.v;
+    });
+    exclude_txids.erase(std::unique(exclude_txids.begin(), exclude_txids.end()), exclude_txids.end());
+
+    // fnv-1a
+    std::uint64_t ret = 0xcbf29ce484222325ULL;
+    for (const gs::txid & txid : exclude_txids) {
+        for (const std::uint8_t c : txid.v) {
+            ret = (ret ^ c) * 0x100000001b3ULL;
+        }
+    }
+
+    return ret;
+}
+
+bool graph_search_cache::get(
+    const gs::txid& txid,
+    const std::vector<gs::txid>& exclude_txids,
+    const std::uint64_t confirmed_epoch,
+    const std::uint64_t mempool_generation,
+    std::shared_ptr<const reply_txdata>& reply
+) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::vector<gs::txid> sorted_exclude_txids(exclude_txids);
+    const auto it = entries.find(key(txid, fingerprint(sorted_exclude_txids)));
+    if (it == entries.end()) {
+        return false;
+    }
+
+    if (it->second.confirmed_epoch != confirmed_epoch
+     || (it->second.mempool_generation != no_mempool && it->second.mempool_generation != mempool_generation)
+    ) {
+        erase(it);
+        return false;
+    }
+
+    if (it->second.exclude_txids != sorted_exclude_txids) {
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, it->second.lru_it);
+    reply = it->second.reply;
+
+    return true;
+}
+
+void graph_search_cache::put(
+    const gs::txid& txid,
+    const std::vector<gs::txid>& exclude_txids,
+    const std::uint64_t confirmed_epoch,
+    const std::uint64_t mempool_generation,
+    reply_txdata&& reply
+) {
+    std::size_t reply_bytes = 0;
+    for (const std::string & txdata : reply) {
+        reply_bytes += txdata.size();
+    }
+
+    if (reply_bytes > max_bytes) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::vector<gs::txid> sorted_exclude_txids(exclude_txids);
+    const key k(txid, fingerprint(sorted_exclude_txids));
+
+    const auto it = entries.find(k);
+    if (it != entries.end()) {
+        erase(it);
+    }
+
+    while (bytes + reply_bytes > max_bytes) {
+        erase(entries.find(lru.back()));
+    }
+
+    lru.push_front(k);
+    bytes += reply_bytes;
+
+    entry e;
+    e.exclude_txids        = std::move(sorted_exclude_txids);
+    e.reply                = std::make_shared<const reply_txdata>(std::move(reply));
+    e.bytes                = reply_bytes;
+    e.confirmed_epoch      = confirmed_epoch;
+    e.mempool_generation   = mempool_generation;
+    e.lru_it               = lru.begin();
+    entries.emplace(k, std::move(e));
+}
+
+void graph_search_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    entries.clear();
+    lru.clear();
+    bytes = 0;
+}
+
+std::size_t graph_search_cache::size()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    return entries.size();
+}
+
+void graph_search_cache::erase(const absl::flat_hash_map<key, entry>::iterator it)
+{
+    bytes -= it->second.bytes;
+    lru.erase(it->second.lru_it);
+    entries.erase(it);
+}
+
+}
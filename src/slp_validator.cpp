@@ -1,6 +1,10 @@
 #include <vector>
+#include <algorithm>
 #include <cstdint>
-#include <functional>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 #include <absl/types/variant.h>
 #include <absl/container/flat_hash_map.h>
@@ -14,18 +18,43 @@
 
 namespace gs {
 
+slp_validator::~slp_validator()
+{
+    for (const auto & m : records) {
+        store.release(m.first);
+    }
+}
+
+bool slp_validator::store_tx(const gs::transaction& tx, bool& inserted)
+{
+    const auto p = records.insert({ tx.txid, gs::slp_record(tx) });
+    inserted = p.second;
+    if (p.second) {
+        gs::tx_handle handle;
+        if (! store.acquire(tx.txid, tx.serialized.data(), tx.serialized.size(), handle)) {
+            records.erase(p.first);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool slp_validator::add_tx(const gs::transaction& tx, const bool trusted)
 {
     if (tx.slp.type != gs::slp_transaction_type::invalid) {
-        const auto p = transaction_map.insert({ tx.txid, tx });
+        bool inserted;
+        if (! store_tx(tx, inserted)) {
+            return false;
+        }
 
         if (trusted) {
             add_valid_txid(tx.txid);
-            return p.second;
+            return inserted;
         }
 
         if (validate(tx.txid)) {
-            return p.second;
+            return inserted;
         } else {
             return false;
         }
@@ -34,19 +63,218 @@ bool slp_validator::add_tx(const gs::transaction& tx, const bool trusted)
     return false;
 }
 
+std::vector<bool> slp_validator::add_txs(
+    const std::vector<const gs::transaction*>& txs,
+    const bool trusted,
+    const unsigned threads
+) {
+    std::vector<bool> ret(txs.size(), false);
+
+    if (trusted || threads <= 1) {
+        for (std::size_t i=0; i<txs.size(); ++i) {
+            ret[i] = add_tx(*txs[i], trusted);
+        }
+        return ret;
+    }
+
+    struct partition
+    {
+        std::vector<std::size_t> txs;    // indices into txs, in order
+        bool                     serial; // validated after the merge instead
+
+        partition()
+        : serial(false)
+        {}
+    };
+
+    // everything is inserted up front so records stay put while workers read them
+    std::vector<char> inserted(txs.size(), 0);
+    absl::flat_hash_set<gs::txid> batch;
+    for (std::size_t i=0; i<txs.size(); ++i) {
+        const gs::transaction & tx = *txs[i];
+        if (tx.slp.type == gs::slp_transaction_type::invalid) {
+            continue;
+        }
+
+        bool is_new;
+        if (! store_tx(tx, is_new)) {
+            continue;
+        }
+
+        inserted[i] = is_new ? 1 : 2;
+        batch.insert(tx.txid);
+    }
+
+    std::vector<partition> partitions;
+    absl::flat_hash_map<gs::tokenid, std::size_t> token_partition;
+    for (std::size_t i=0; i<txs.size(); ++i) {
+        if (inserted[i] == 0) {
+            continue;
+        }
+
+        const gs::transaction & tx = *txs[i];
+        const auto p = token_partition.insert({ tx.slp.tokenid, partitions.size() });
+        if (p.second) {
+            partitions.emplace_back();
+        }
+
+        partition & part = partitions[p.first->second];
+        part.txs.push_back(i);
+
+        // already known ones go through validate(txid) like add_tx does, and a child
+        // genesis may spend a group transaction which is validated in another partition
+        if (inserted[i] == 2
+        || (tx.slp.type == gs::slp_transaction_type::genesis
+         && tx.slp.token_type == 0x41
+         && ! tx.inputs.empty()
+         && batch.count(tx.inputs[0].txid))
+        ) {
+            part.serial = true;
+        }
+    }
+
+    std::vector<const gs::slp_record*> stored(txs.size(), nullptr);
+    for (std::size_t i=0; i<txs.size(); ++i) {
+        if (inserted[i] != 0) {
+            stored[i] = &records.find(txs[i]->txid)->second;
+        }
+    }
+
+    std::vector<char> passed(txs.size(), 0);
+    std::vector<slp_validation_cost> costs(txs.size());
+    std::atomic<std::size_t> next_partition(0);
+    const auto work = [&] {
+        for (std::size_t n = next_partition++; n < partitions.size(); n = next_partition++) {
+            const partition & part = partitions[n];
+            if (part.serial) {
+                continue;
+            }
+
+            overlay pending;
+            for (const std::size_t i : part.txs) {
+                const gs::txid & txid = txs[i]->txid;
+                const gs::slp_record & record = *stored[i];
+                if (! validate(txid, record, &pending, costs[i])) {
+                    continue;
+                }
+
+                passed[i] = 1;
+                pending.valid.insert(txid);
+
+                if (record.mint_baton_vout != 0) {
+                    pending.mint_batons.emplace(
+                        gs::outpoint(txid, record.mint_baton_vout),
+                        mint_baton { record.tokenid, record.token_type }
+                    );
+                }
+            }
+        }
+    };
+
+    const std::size_t num_parallel = std::count_if(partitions.begin(), partitions.end(),
+        [](const partition & part) { return ! part.serial; });
+
+    std::vector<std::thread> workers;
+    const std::size_t num_workers = num_parallel < min_parallel_partitions
+        ? 1
+        : std::min<std::size_t>(threads, num_parallel);
+    for (std::size_t n=1; n<num_workers; ++n) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread & worker : workers) {
+        worker.join();
+    }
+
+    // merged in order of txs so the outcome does not depend on scheduling
+    for (std::size_t i=0; i<txs.size(); ++i) {
+        if (inserted[i] == 0 || partitions[token_partition[txs[i]->slp.tokenid]].serial) {
+            continue;
+        }
+
+        stats.record(txs[i]->txid, txs[i]->slp.tokenid, costs[i]);
+        if (passed[i]) {
+            add_valid_txid(txs[i]->txid);
+            ret[i] = true;
+        } else {
+            add_invalid(txs[i]->txid, *stored[i]);
+        }
+    }
+
+    for (std::size_t i=0; i<txs.size(); ++i) {
+        if (inserted[i] == 0 || ! partitions[token_partition[txs[i]->slp.tokenid]].serial) {
+            continue;
+        }
+
+        ret[i] = validate(txs[i]->txid) && inserted[i] == 1;
+    }
+
+    return ret;
+}
+
 bool slp_validator::remove_tx(const gs::txid& txid)
 {
-    return transaction_map.erase(txid) > 0;
+    valid.erase(txid);
+    forget_invalid(txid); // needs the inputs, so before the erase
+
+    const auto record_search = records.find(txid);
+    if (record_search == records.end()) {
+        return false;
+    }
+
+    const std::uint32_t baton_vout = record_search->second.mint_baton_vout;
+    if (baton_vout != 0) {
+        mint_batons.erase(gs::outpoint(txid, baton_vout));
+    }
+
+    records.erase(record_search);
+
+    store.release(txid);
+    return true;
+}
+
+void slp_validator::clear()
+{
+    for (const auto & m : records) {
+        store.release(m.first);
+    }
+
+    records.clear();
+    valid.clear();
+    invalid.clear();
+    invalid_spenders.clear();
+    mint_batons.clear();
 }
 
 bool slp_validator::add_valid_txid(const gs::txid& txid)
 {
-    return valid.insert(txid).second;
+    // valid may have been filled in before the transaction arrived (snapshots)
+    const bool inserted = valid.insert(txid).second;
+
+    const auto record_search = records.find(txid);
+    if (record_search != records.end()) {
+        const gs::slp_record & record = record_search->second;
+        if (record.mint_baton_vout != 0) {
+            mint_batons.emplace(
+                gs::outpoint(txid, record.mint_baton_vout),
+                mint_baton { record.tokenid, record.token_type }
+            );
+        }
+    }
+
+    if (! inserted) {
+        return false;
+    }
+
+    forget_invalid(txid);
+    forget_invalid_spenders(txid);
+
+    return true;
 }
 
 bool slp_validator::has(const gs::txid& txid) const
 {
-    return transaction_map.count(txid) == 1;
+    return records.count(txid) == 1;
 }
 
 bool slp_validator::has_valid(const gs::txid& txid) const
@@ -54,9 +282,158 @@ bool slp_validator::has_valid(const gs::txid& txid) const
     return valid.count(txid) == 1;
 }
 
-gs::transaction slp_validator::get(const gs::txid& txid) const
+bool slp_validator::has_invalid(const gs::txid& txid) const
+{
+    return invalid.count(txid) == 1;
+}
+
+bool slp_validator::is_valid(const gs::txid& txid, const overlay* pending, slp_validation_cost & cost) const
+{
+    ++cost.lookups;
+    if (has_valid(txid)) {
+        return true;
+    }
+
+    if (pending) {
+        ++cost.lookups;
+        return pending->valid.count(txid) == 1;
+    }
+
+    return false;
+}
+
+const gs::slp_record* slp_validator::find_record(const gs::txid& txid, slp_validation_cost & cost) const
 {
-    return transaction_map.at(txid);
+    ++cost.lookups;
+    return find(txid);
+}
+
+const slp_validator::mint_baton* slp_validator::find_mint_baton(
+    const gs::outpoint& outpoint,
+    const overlay* pending,
+    slp_validation_cost & cost
+) const {
+    ++cost.lookups;
+    const auto it = mint_batons.find(outpoint);
+    if (it != mint_batons.end()) {
+        return &it->second;
+    }
+
+    if (pending) {
+        ++cost.lookups;
+        const auto pending_it = pending->mint_batons.find(outpoint);
+        if (pending_it != pending->mint_batons.end()) {
+            return &pending_it->second;
+        }
+    }
+
+    return nullptr;
+}
+
+void slp_validator::add_invalid(const gs::txid & txid, const gs::slp_record & record)
+{
+    slp_invalid_reason reason;
+    switch (record.type) {
+        case gs::slp_transaction_type::send:    reason = slp_invalid_reason::send_inputs;   break;
+        case gs::slp_transaction_type::mint:    reason = slp_invalid_reason::mint_baton;    break;
+        case gs::slp_transaction_type::genesis: reason = slp_invalid_reason::genesis_input; break;
+        default: return; // never enters records
+    }
+
+    if (! invalid.emplace(txid, reason).second) {
+        return;
+    }
+
+    for (const gs::outpoint & i_outpoint : record.inputs) {
+        if (! has(i_outpoint.txid)) {
+            continue;
+        }
+
+        std::vector<gs::txid>& spenders = invalid_spenders[i_outpoint.txid];
+        if (spenders.empty() || spenders.back() != txid) {
+            spenders.push_back(txid);
+        }
+    }
+}
+
+void slp_validator::forget_invalid(const gs::txid & txid)
+{
+    if (invalid.erase(txid) == 0) {
+        return;
+    }
+
+    const auto record_search = records.find(txid);
+    if (record_search == records.end()) {
+        return;
+    }
+
+    for (const gs::outpoint & i_outpoint : record_search->second.inputs) {
+        const auto it = invalid_spenders.find(i_outpoint.txid);
+        if (it == invalid_spenders.end()) {
+            continue;
+        }
+
+        std::vector<gs::txid>& spenders = it->second;
+        spenders.erase(std::remove(spenders.begin(), spenders.end(), txid), spenders.end());
+        if (spenders.empty()) {
+            invalid_spenders.erase(it);
+        }
+    }
+}
+
+// rejections further down may have come from one higher up, so this is transitive
+void slp_validator::forget_invalid_spenders(const gs::txid & txid)
+{
+    std::vector<gs::txid> stack({ txid });
+
+    while (! stack.empty()) {
+        const gs::txid input_txid = stack.back();
+        stack.pop_back();
+
+        const auto it = invalid_spenders.find(input_txid);
+        if (it == invalid_spenders.end()) {
+            continue;
+        }
+
+        const std::vector<gs::txid> spenders = std::move(it->second);
+        invalid_spenders.erase(it);
+
+        for (const gs::txid & spender : spenders) {
+            if (invalid.count(spender)) {
+                forget_invalid(spender);
+                stack.push_back(spender);
+            }
+        }
+    }
+}
+
+const gs::slp_record* slp_validator::find(const gs::txid& txid) const
+{
+    const auto it = records.find(txid);
+    return it == records.end() ? nullptr : &it->second;
+}
+
+bool slp_validator::txdata(const gs::txid& txid, const std::uint8_t*& data, std::size_t& size) const
+{
+    gs::tx_handle handle;
+    if (! store.find(txid, handle)) {
+        return false;
+    }
+
+    data = store.data(handle);
+    size = handle.size;
+    return true;
+}
+
+bool slp_validator::get(const gs::txid& txid, gs::transaction& tx) const
+{
+    const std::uint8_t* data = nullptr;
+    std::size_t size = 0;
+    if (! has(txid) || ! txdata(txid, data, size)) {
+        return false;
+    }
+
+    return tx.hydrate(data, data + size);
 }
 
 
@@ -87,30 +464,29 @@ gs::transaction slp_validator::get(const gs::txid& txid) const
 #endif
 
 
+// inputs only count once they are valid, so nothing below them is ever walked
 bool slp_validator::check_send(
-    absl::flat_hash_set<gs::txid> & seen,
-    const gs::transaction & tx
-) {
-#ifdef ENABLE_SLP_VALIDATE_DEBUG_PRINTING
-    std::cerr << "send: " << tx.txid.decompress(true) << "\n";
-#endif
-    const auto & s = absl::get<gs::slp_transaction_send>(tx.slp.slp_tx);
-
+    const gs::slp_record & record,
+    const overlay* pending,
+    slp_validation_cost & cost
+) const {
     absl::uint128 output_amount = 0;
-    for (const auto n : s.amounts) {
+    for (const auto n : record.amounts) {
         output_amount += n;
     }
 
     absl::uint128 input_amount = 0;
-    for (const auto & i_outpoint : tx.inputs) {
-        VALIDATE_CONTINUE (! has_valid(i_outpoint.txid));
-        VALIDATE_CONTINUE (! transaction_map.count(i_outpoint.txid));
+    for (const auto & i_outpoint : record.inputs) {
+        ++cost.inputs;
+        VALIDATE_CONTINUE (! is_valid(i_outpoint.txid, pending, cost));
+
+        const gs::slp_record* txi_ptr = find_record(i_outpoint.txid, cost);
+        VALIDATE_CONTINUE (txi_ptr == nullptr);
 
-        const gs::transaction & txi = transaction_map.at(i_outpoint.txid);
+        const gs::slp_record & txi = *txi_ptr;
 
-        VALIDATE_CONTINUE (tx.slp.token_type != txi.slp.token_type);
-        VALIDATE_CONTINUE (tx.slp.tokenid    != txi.slp.tokenid);
-        VALIDATE_CONTINUE (! check_outputs_valid(seen, txi));
+        VALIDATE_CONTINUE (record.token_type != txi.token_type);
+        VALIDATE_CONTINUE (record.tokenid    != txi.tokenid);
 
         input_amount += txi.output_slp_amount(i_outpoint.vout);
     }
@@ -120,152 +496,80 @@ bool slp_validator::check_send(
     return true;
 }
 
+// every baton a valid mint spends comes from a valid genesis or mint, so one lookup is enough
 bool slp_validator::check_mint(
-    const gs::transaction & tx
-) {
-    std::function<std::vector<gs::transaction>(
-        const gs::transaction&,
-        const gs::transaction&
-    )> walk_mints_home = [&](
-        const gs::transaction& front,
-        const gs::transaction& back
-    ) -> std::vector<gs::transaction> {
-#ifdef ENABLE_SLP_VALIDATE_DEBUG_PRINTING
-        std::cerr
-            << "mint:"
-            << " front " << front.txid.decompress(true)
-            << " back "  << back.txid.decompress(true)
-            << "\n";
-#endif
-        std::vector<gs::transaction> ret;
-
-        if (front.slp.tokenid    != back.slp.tokenid) {
-            return {};
-        }
-        if (front.slp.token_type != back.slp.token_type) {
-            return {};
-        }
-
-        for (const auto & i_outpoint : back.inputs) {
-            VALIDATE_CONTINUE (! has_valid(i_outpoint.txid));
-            VALIDATE_CONTINUE (! transaction_map.count(i_outpoint.txid));
-
-            const gs::transaction & txi = transaction_map.at(i_outpoint.txid);
+    const gs::slp_record & record,
+    const overlay* pending,
+    slp_validation_cost & cost
+) const {
+    for (const auto & i_outpoint : record.inputs) {
+        ++cost.inputs;
+        const mint_baton* baton = find_mint_baton(i_outpoint, pending, cost);
+        VALIDATE_CONTINUE (baton == nullptr);
+        VALIDATE_CONTINUE (record.tokenid    != baton->tokenid);
+        VALIDATE_CONTINUE (record.token_type != baton->token_type);
 
-            VALIDATE_CONTINUE (front.slp.tokenid    != txi.slp.tokenid);
-            VALIDATE_CONTINUE (front.slp.token_type != txi.slp.token_type);
-            VALIDATE_CONTINUE (i_outpoint != txi.mint_baton_outpoint());
-
-            if (txi.slp.type == gs::slp_transaction_type::mint) {
-                ret.push_back(txi);
-            }
-            else if (txi.slp.type == gs::slp_transaction_type::genesis) {
-                ret.push_back(txi);
-            }
-        }
-
-        return ret;
-    };
-
-    gs::transaction back = tx;
-    std::vector<gs::transaction> input_txs;
-
-    input_txs = walk_mints_home(back, back);
-
-    while (true) {
-        std::vector<gs::transaction> inputs;
-
-        for (auto & front : input_txs) {
-            if (front.slp.type == gs::slp_transaction_type::genesis) {
-                return true;
-            }
-
-            std::vector<gs::transaction> partial = walk_mints_home(back, front);
-            for (auto & ptx : partial) {
-                inputs.push_back(ptx);
-            }
-        }
-
-        if (inputs.size() < 1) {
-            std::cerr << "inputs size: " << inputs.size() << " txid: " << tx.txid.decompress(true) << "\n";
-            return false;
-        }
-
-        // this should only be possible from burning the value output of genesis combined with genesis mint
-        if (inputs.size() > 1) {
-            gs::txid txidi = inputs[0].txid;
-
-            // so we should check this condition holds (i.e. both have same txid)
-            for (auto & txi : inputs) {
-                if (txidi != txi.txid) {
-                    std::cerr
-                        << "mint rare condition: "
-                        << txidi.decompress(true)
-                        << " "
-                        << txi.txid.decompress(true)
-                        << "\n";
-                    throw std::runtime_error("mint rare condition");
-                }
-            }
-        }
-
-        input_txs = inputs;
-        back = input_txs[0];
-
-        if (has_valid(back.txid)) {
-            return true;
-        }
+        return true;
     }
 
     return false;
 }
 
 bool slp_validator::check_genesis(
-    const gs::transaction & tx
-) {
-#ifdef ENABLE_SLP_VALIDATE_DEBUG_PRINTING
-    std::cerr << "genesis: " << tx.txid.decompress(true) << "\n";
-#endif
-    if (tx.slp.token_type == 0x41) {
-        VALIDATE_CHECK (tx.inputs.size() == 0);
-        const gs::outpoint& i_outpoint = tx.inputs[0];
-        VALIDATE_CHECK (! has_valid(i_outpoint.txid));
-        VALIDATE_CHECK (! transaction_map.count(i_outpoint.txid));
-
-        const gs::transaction & txi = transaction_map.at(i_outpoint.txid);
-        VALIDATE_CHECK (txi.slp.token_type != 0x81);
+    const gs::slp_record & record,
+    const overlay* pending,
+    slp_validation_cost & cost
+) const {
+    if (record.token_type == 0x41) {
+        VALIDATE_CHECK (record.inputs.size() == 0);
+        const gs::outpoint& i_outpoint = record.inputs[0];
+        ++cost.inputs;
+        VALIDATE_CHECK (! is_valid(i_outpoint.txid, pending, cost));
+
+        const gs::slp_record* txi_ptr = find_record(i_outpoint.txid, cost);
+        VALIDATE_CHECK (txi_ptr == nullptr);
+
+        const gs::slp_record & txi = *txi_ptr;
+        VALIDATE_CHECK (txi.token_type != 0x81);
         VALIDATE_CHECK (txi.output_slp_amount(i_outpoint.vout) < 1);
 
-        return validate(txi);
+        // txi is valid already
+        return true;
     }
 
     return true;
 }
 
-bool slp_validator::check_outputs_valid (
-    absl::flat_hash_set<gs::txid> & seen,
-    const gs::transaction & tx
-) {
+bool slp_validator::validate(
+    const gs::txid & txid,
+    const gs::slp_record & record,
+    const overlay* pending,
+    slp_validation_cost & cost
+) const {
 #ifdef ENABLE_SLP_VALIDATE_DEBUG_PRINTING
-    std::cerr << "check_outputs_valid: " << tx.txid.decompress(true) << "\n";
+    std::cerr << "validate(record): " << txid.decompress(true) << "\n";
 #endif
-    VALIDATE_CHECK (! has(tx.txid));
-
-    // already has been validated during search
-    if (! seen.insert(tx.txid).second) {
-        return true;
+    const auto start = std::chrono::steady_clock::now();
+
+    bool is_valid_tx = false;
+    if (record.type == gs::slp_transaction_type::invalid) {
+        is_valid_tx = false;
+    } else if (is_valid(txid, pending, cost)) {
+        is_valid_tx = true;
+    } else {
+        switch (record.type) {
+            case gs::slp_transaction_type::send:    is_valid_tx = check_send(record, pending, cost);    break;
+            case gs::slp_transaction_type::mint:    is_valid_tx = check_mint(record, pending, cost);    break;
+            case gs::slp_transaction_type::genesis: is_valid_tx = check_genesis(record, pending, cost); break;
+            default: break;
+        }
     }
 
-    if (valid.count(tx.txid) > 0) {
-        return true;
-    }
+    cost.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start
+    ).count();
 
-    switch (tx.slp.type) {
-        case gs::slp_transaction_type::send:    return check_send(seen, tx);
-        case gs::slp_transaction_type::mint:    return check_mint(tx);
-        case gs::slp_transaction_type::genesis: return check_genesis(tx);
-        default: return false;
-    }
+    return is_valid_tx;
 }
 
 bool slp_validator::validate(const gs::transaction & tx)
@@ -273,22 +577,11 @@ bool slp_validator::validate(const gs::transaction & tx)
 #ifdef ENABLE_SLP_VALIDATE_DEBUG_PRINTING
     std::cerr << "validate(tx): " << tx.txid.decompress(true) << "\n";
 #endif
-    if (tx.slp.type == gs::slp_transaction_type::invalid) {
-        return false;
-    }
-
-    if (has_valid(tx.txid)) {
-        return true;
-    }
-
-    absl::flat_hash_set<gs::txid> seen;
-
-    switch (tx.slp.type) {
-        case gs::slp_transaction_type::send:    return check_send(seen, tx);
-        case gs::slp_transaction_type::mint:    return check_mint(tx);
-        case gs::slp_transaction_type::genesis: return check_genesis(tx);
-        default: return false;
-    }
+    const gs::slp_record record(tx);
+    slp_validation_cost cost;
+    const bool is_valid_tx = validate(tx.txid, record, nullptr, cost);
+    stats.record(tx.txid, record.tokenid, cost);
+    return is_valid_tx;
 }
 
 bool slp_validator::validate(const gs::txid & txid)
@@ -297,9 +590,16 @@ bool slp_validator::validate(const gs::txid & txid)
     std::cerr << "validate(txid): " << txid.decompress(true) << "\n";
 #endif
     VALIDATE_CHECK (! has(txid));
-    const bool is_valid = validate(transaction_map.at(txid));
+    VALIDATE_CHECK (has_invalid(txid));
+
+    const gs::slp_record & record = records.at(txid);
+    slp_validation_cost cost;
+    const bool is_valid = validate(txid, record, nullptr, cost);
+    stats.record(txid, record.tokenid, cost);
     if (is_valid) {
         add_valid_txid(txid);
+    } else {
+        add_invalid(txid, record);
     }
 
 #ifdef ENABLE_SLP_VALIDATE_DEBUG_PRINTING
@@ -0,0 +1,252 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+
+#include <absl/container/flat_hash_map.h>
+#include <spdlog/spdlog.h>
+
+#include <gs++/bhash.hpp>
+#include <gs++/slp_record.hpp>
+#include <gs++/slp_validator.hpp>
+#include <gs++/slp_validator_snapshot.hpp>
+#include <gs++/snapshot_io.hpp>
+
+namespace gs {
+
+constexpr std::uint32_t slp_validator_snapshot::version;
+
+namespace {
+
+constexpr char snapshot_magic[8] = { 'G', 'S', 'S', 'L', 'P', 'V', 'A', 'L' };
+
+struct snapshot_record_header
+{
+    std::uint8_t  txid[32];
+    std::uint8_t  tokenid[32];
+    std::uint32_t num_outputs;
+    std::uint32_t mint_baton_vout;
+    std::uint32_t num_inputs;
+    std::uint32_t num_amounts;
+    std::uint32_t txdata_size;
+    std::uint16_t token_type;
+    std::uint8_t  type;
+    std::uint8_t  padding;
+};
+static_assert(sizeof(snapshot_record_header) == 88, "record header must be 88 bytes");
+
+// one record of the image, txdata points into the mapping
+// record is moved out once it is read
+struct snapshot_record
+{
+    gs::txid            txid;
+    gs::slp_record      record;
+    const std::uint8_t* txdata;
+    std::size_t         txdata_size;
+};
+
+bool read_snapshot_record(snapshot_reader& reader, snapshot_record& ret)
+{
+    snapshot_record_header header;
+    if (! reader.read(&header, sizeof(header))) {
+        return false;
+    }
+
+    const gs::slp_transaction_type type = static_cast<gs::slp_transaction_type>(header.type);
+    if (type != gs::slp_transaction_type::genesis
+     && type != gs::slp_transaction_type::mint
+     && type != gs::slp_transaction_type::send
+    ) {
+        return false;
+    }
+
+    std::memcpy(ret.txid.data(), header.txid, sizeof(header.txid));
+    std::memcpy(ret.record.tokenid.data(), header.tokenid, sizeof(header.tokenid));
+    ret.record.num_outputs     = header.num_outputs;
+    ret.record.mint_baton_vout = header.mint_baton_vout;
+    ret.record.token_type      = header.token_type;
+    ret.record.type            = type;
+
+    // sized from the image before anything is allocated for them
+    constexpr std::size_t input_size = 32 + sizeof(std::uint32_t);
+    const std::uint8_t* inputs = reader.view(static_cast<std::uint64_t>(header.num_inputs) * input_size);
+    if (inputs == nullptr) {
+        return false;
+    }
+
+    ret.record.inputs.resize(header.num_inputs);
+    for (std::size_t i=0; i<header.num_inputs; ++i) {
+        gs::outpoint & input = ret.record.inputs[i];
+        std::memcpy(input.txid.data(), inputs + i*input_size, 32);
+        std::memcpy(&input.vout, inputs + i*input_size + 32, sizeof(input.vout));
+    }
+
+    ret.txdata_size = header.txdata_size;
+    ret.txdata = nullptr;
+    if (! reader.read_vector(ret.record.amounts, header.num_amounts)
+     || (ret.txdata = reader.view(header.txdata_size)) == nullptr
+     || ! reader.pad()
+    ) {
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+bool slp_validator_snapshot::save(
+    const std::string& path,
+    const slp_validator& validator,
+    const std::function<bool(const gs::txid&)>& confirmed
+) {
+    // a mempool transaction restored as known would be skipped when it is seen again
+    std::vector<const std::pair<const gs::txid, gs::slp_record>*> saved_records;
+    for (const auto & it : validator.records) {
+        if (confirmed(it.first)) {
+            saved_records.push_back(&it);
+        }
+    }
+
+    std::vector<gs::txid> saved_valid;
+    for (const gs::txid & txid : validator.valid) {
+        if (confirmed(txid)) {
+            saved_valid.push_back(txid);
+        }
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    snapshot_writer writer(tmp_path);
+    if (! writer.out) {
+        spdlog::error("validator snapshot: could not open {}", tmp_path);
+        return false;
+    }
+
+    writer.write_u64(saved_records.size());
+    for (const auto * it : saved_records) {
+        const gs::txid & txid = it->first;
+        const gs::slp_record & record = it->second;
+
+        const std::uint8_t* txdata = nullptr;
+        std::size_t txdata_size = 0;
+        if (! validator.txdata(txid, txdata, txdata_size)) {
+            spdlog::error("validator snapshot: no txdata for {}", txid.decompress(true));
+            writer.out.close();
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+
+        snapshot_record_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.txid, txid.data(), sizeof(header.txid));
+        std::memcpy(header.tokenid, record.tokenid.data(), sizeof(header.tokenid));
+        header.num_outputs     = record.num_outputs;
+        header.mint_baton_vout = record.mint_baton_vout;
+        header.num_inputs      = record.inputs.size();
+        header.num_amounts     = record.amounts.size();
+        header.txdata_size     = txdata_size;
+        header.token_type      = record.token_type;
+        header.type            = static_cast<std::uint8_t>(record.type);
+
+        writer.write(&header, sizeof(header));
+        for (const gs::outpoint & input : record.inputs) {
+            writer.write(input.txid.data(), input.txid.size());
+            writer.write(&input.vout, sizeof(input.vout));
+        }
+        writer.write_vector(record.amounts);
+        writer.write(txdata, txdata_size);
+        writer.pad();
+    }
+
+    writer.write_u64(saved_valid.size());
+    writer.write_vector(saved_valid);
+    writer.pad();
+
+    if (! writer.finish(snapshot_magic, version, height, block_hash, tmp_path, path, "validator snapshot")) {
+        return false;
+    }
+
+    spdlog::info("validator snapshot: saved {} records at height {} to {}", saved_records.size(), height, path);
+    return true;
+}
+
+bool slp_validator_snapshot::load(
+    const std::string& path,
+    slp_validator& validator
+) {
+    const std::shared_ptr<const snapshot_mapping> mapping = std::make_shared<const snapshot_mapping>(path);
+    snapshot_header header;
+    if (! mapping->check(snapshot_magic, version, path, "validator snapshot", header)) {
+        return false;
+    }
+
+    const std::uint8_t* body = mapping->data + snapshot_header_size;
+    snapshot_reader reader(body, header.body_size);
+
+    std::uint64_t n_records;
+    if (! reader.read_u64(n_records) || n_records > header.body_size / sizeof(snapshot_record_header)) {
+        spdlog::error("validator snapshot: {} is malformed", path);
+        return false;
+    }
+
+    std::vector<snapshot_record> image_records(n_records);
+    absl::flat_hash_map<gs::txid, gs::slp_record> records;
+    records.reserve(n_records);
+    for (snapshot_record & r : image_records) {
+        if (! read_snapshot_record(reader, r) || ! records.emplace(r.txid, std::move(r.record)).second) {
+            spdlog::error("validator snapshot: {} is malformed", path);
+            return false;
+        }
+    }
+
+    std::uint64_t n_valid;
+    std::vector<gs::txid> valid_txids;
+    if (! reader.read_u64(n_valid)
+     || ! reader.read_vector(valid_txids, n_valid)
+     || ! reader.pad()
+     || ! reader.done()
+    ) {
+        spdlog::error("validator snapshot: {} is malformed", path);
+        return false;
+    }
+
+    // txdata is served straight out of the mapping from here on
+    std::uint64_t base;
+    if (! validator.store.add_region(body, header.body_size, mapping, base)) {
+        return false;
+    }
+
+    // records only go into the validator once they hold a store reference
+    for (std::size_t i=0; i<image_records.size(); ++i) {
+        const snapshot_record & r = image_records[i];
+        gs::tx_handle handle(base + (r.txdata - body), static_cast<std::uint32_t>(r.txdata_size));
+        if (r.txdata_size > tx_store::chunk_size || ! validator.store.acquire_region(r.txid, handle)) {
+            spdlog::error("validator snapshot: could not store {}", r.txid.decompress(true));
+            for (std::size_t j=0; j<i; ++j) {
+                validator.store.release(image_records[j].txid);
+            }
+            return false;
+        }
+    }
+
+    validator.records = std::move(records);
+    validator.valid.insert(valid_txids.begin(), valid_txids.end());
+
+    for (const gs::txid & txid : valid_txids) {
+        const gs::slp_record* record = validator.find(txid);
+        if (record && record->mint_baton_vout != 0) {
+            validator.mint_batons.emplace(
+                gs::outpoint(txid, record->mint_baton_vout),
+                slp_validator::mint_baton { record->tokenid, record->token_type }
+            );
+        }
+    }
+
+    height = header.height;
+    std::memcpy(block_hash.data(), header.block_hash, sizeof(header.block_hash));
+
+    spdlog::info("validator snapshot: loaded {} records at height {} from {}", n_records, height, path);
+    return true;
+}
+
+}
@@ -4,21 +4,18 @@
 namespace gs {
 
 // get all slp inputs
-// expensive call involving slp_validator to look back into the past
+// looks up the transaction of every input in slp_validator
 std::vector<gs::outpoint> transaction::slp_inputs(const gs::slp_validator & validator) const
 {
     std::vector<gs::outpoint> result;
     for (const  auto & input : inputs) {
-        if (!validator.has(input.txid)) {
+        const gs::slp_record* prevTx = validator.find(input.txid);
+        if (prevTx == nullptr) {
             continue;
         }
 
-        const auto & prevTx = validator.get(input.txid);
-        for (const auto & prevOutput : prevTx.slp_outputs()) {
-            if (prevOutput.prev_out_idx == input.vout && prevOutput.prev_tx_id == input.txid) {
-                result.emplace_back(gs::outpoint(input));
-                break;
-            }
+        if (prevTx->is_slp_output(input.vout)) {
+            result.emplace_back(gs::outpoint(input));
         }
     }
 
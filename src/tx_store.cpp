@@ -0,0 +1,286 @@
+#include <cstring>
+#include <mutex>
+#include <map>
+#include <set>
+#include <iterator>
+
+#include <spdlog/spdlog.h>
+
+#include <gs++/bhash.hpp>
+#include <gs++/tx_store.hpp>
+
+namespace gs {
+
+constexpr std::size_t tx_store::chunk_bits;
+constexpr std::size_t tx_store::chunk_size;
+constexpr std::size_t tx_store::max_chunks;
+
+tx_store::tx_store()
+: chunks(new std::atomic<std::uint8_t*>[max_chunks])
+, next(0)
+, used(0)
+, free_total(0)
+, borrowed(max_chunks, false)
+{
+    for (std::size_t i=0; i<max_chunks; ++i) {
+        chunks[i] = nullptr;
+    }
+}
+
+tx_store::~tx_store()
+{
+    for (std::size_t i=0; i<max_chunks; ++i) {
+        if (! borrowed[i]) {
+            delete[] chunks[i].load();
+        }
+    }
+}
+
+bool tx_store::acquire(
+    const gs::txid& txid,
+    const std::uint8_t* data,
+    const std::size_t size,
+    tx_handle& handle
+) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    const auto it = entries.find(txid);
+    if (it != entries.end()) {
+        ++it->second.refs;
+        handle = it->second.handle;
+        return true;
+    }
+
+    if (size > chunk_size) {
+        spdlog::error("tx_store: {} is too large ({} bytes)", txid.decompress(true), size);
+        return false;
+    }
+
+    std::uint64_t offset;
+    if (! allocate(size, offset)) {
+        return false;
+    }
+
+    std::memcpy(chunks[offset >> chunk_bits].load() + (offset & (chunk_size - 1)), data, size);
+    used += size;
+
+    handle = tx_handle(offset, static_cast<std::uint32_t>(size));
+    entries.emplace(txid, entry { handle, 1 });
+
+    return true;
+}
+
+bool tx_store::allocate(const std::size_t size, std::uint64_t& offset)
+{
+    // best fit out of the released ranges, the rest of the range stays free
+    const auto fit = free_by_size.lower_bound(std::make_pair(static_cast<std::uint64_t>(size), std::uint64_t(0)));
+    if (fit != free_by_size.end()) {
+        const std::uint64_t fit_offset = fit->second;
+        const std::uint64_t fit_size   = fit->first;
+        erase_free(free_by_offset.find(fit_offset));
+
+        offset = fit_offset;
+        if (fit_size > size) {
+            insert_free(fit_offset + size, fit_size - size);
+        }
+        return true;
+    }
+
+    // transactions never straddle chunks, the end of a chunk too small to hold
+    // this one is kept for smaller ones
+    offset = next;
+    if ((offset & (chunk_size - 1)) + size > chunk_size) {
+        const std::uint64_t chunk_end = ((offset >> chunk_bits) + 1) << chunk_bits;
+        if ((offset & (chunk_size - 1)) != 0) {
+            insert_free(offset, chunk_end - offset);
+        }
+        offset = chunk_end;
+    }
+
+    const std::size_t chunk = offset >> chunk_bits;
+    if (chunk >= max_chunks) {
+        spdlog::error("tx_store: out of chunks");
+        return false;
+    }
+
+    if (chunks[chunk].load() == nullptr) {
+        chunks[chunk] = new std::uint8_t[chunk_size];
+    }
+
+    next = offset + size;
+    return true;
+}
+
+void tx_store::free_range(std::uint64_t offset, std::uint64_t size)
+{
+    std::uint64_t end = offset + size;
+
+    // neighbours are only merged inside of the same chunk
+    const auto after = free_by_offset.lower_bound(offset);
+    if (after != free_by_offset.end() && after->first == end && (end & (chunk_size - 1)) != 0) {
+        end += after->second;
+        erase_free(after);
+    }
+
+    const auto before = free_by_offset.lower_bound(offset);
+    if (before != free_by_offset.begin() && (offset & (chunk_size - 1)) != 0) {
+        const auto prev = std::prev(before);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            erase_free(prev);
+        }
+    }
+
+    // the end of what was handed out moves back instead
+    if (end == next) {
+        next = offset;
+        return;
+    }
+
+    insert_free(offset, end - offset);
+}
+
+void tx_store::insert_free(const std::uint64_t offset, const std::uint64_t size)
+{
+    free_by_offset.emplace(offset, size);
+    free_by_size.emplace(size, offset);
+    free_total += size;
+}
+
+void tx_store::erase_free(const std::map<std::uint64_t, std::uint64_t>::iterator it)
+{
+    free_by_size.erase(std::make_pair(it->second, it->first));
+    free_total -= it->second;
+    free_by_offset.erase(it);
+}
+
+bool tx_store::acquire(const gs::txid& txid)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    const auto it = entries.find(txid);
+    if (it == entries.end()) {
+        return false;
+    }
+
+    ++it->second.refs;
+    return true;
+}
+
+bool tx_store::add_region(
+    const std::uint8_t* data,
+    const std::size_t size,
+    std::shared_ptr<const void> owner,
+    std::uint64_t& base
+) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    // regions start on a chunk of their own, appends continue after them
+    const std::size_t first = (next + chunk_size - 1) >> chunk_bits;
+    const std::size_t count = (size + chunk_size - 1) >> chunk_bits;
+    if (first + count > max_chunks) {
+        spdlog::error("tx_store: out of chunks");
+        return false;
+    }
+
+    if ((next & (chunk_size - 1)) != 0) {
+        insert_free(next, (static_cast<std::uint64_t>(first) << chunk_bits) - next);
+    }
+
+    for (std::size_t i=0; i<count; ++i) {
+        chunks[first + i] = const_cast<std::uint8_t*>(data) + i*chunk_size;
+        borrowed[first + i] = true;
+    }
+
+    base = static_cast<std::uint64_t>(first) << chunk_bits;
+    next = static_cast<std::uint64_t>(first + count) << chunk_bits;
+    region_owners.push_back(std::move(owner));
+
+    return true;
+}
+
+bool tx_store::acquire_region(
+    const gs::txid& txid,
+    tx_handle& handle
+) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    const auto it = entries.find(txid);
+    if (it != entries.end()) {
+        ++it->second.refs;
+        handle = it->second.handle;
+        return true;
+    }
+
+    if (! borrowed[handle.offset >> chunk_bits]) {
+        spdlog::error("tx_store: {} is not inside of a region", txid.decompress(true));
+        return false;
+    }
+
+    entries.emplace(txid, entry { handle, 1 });
+    used += handle.size;
+
+    return true;
+}
+
+void tx_store::release(const gs::txid& txid)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    const auto it = entries.find(txid);
+    if (it == entries.end()) {
+        return;
+    }
+
+    if (--it->second.refs == 0) {
+        const tx_handle handle = it->second.handle;
+        entries.erase(it);
+        used -= handle.size;
+
+        if (! borrowed[handle.offset >> chunk_bits]) {
+            free_range(handle.offset, handle.size);
+        }
+    }
+}
+
+bool tx_store::find(const gs::txid& txid, tx_handle& handle)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    const auto it = entries.find(txid);
+    if (it == entries.end()) {
+        return false;
+    }
+
+    handle = it->second.handle;
+    return true;
+}
+
+std::size_t tx_store::size()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    return entries.size();
+}
+
+std::uint64_t tx_store::bytes()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    return used;
+}
+
+std::uint64_t tx_store::free_bytes()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    return free_total;
+}
+
+tx_store& tx_store::shared()
+{
+    static tx_store store;
+    return store;
+}
+
+}
@@ -1,9 +1,11 @@
 #include <string>
 #include <vector>
-#include <stack>
 #include <fstream>
 #include <iterator>
 #include <algorithm>
+#include <utility>
+#include <memory>
+#include <limits>
 
 #include <boost/thread.hpp>
 #include <absl/container/flat_hash_set.h>
@@ -18,149 +20,1025 @@
 
 namespace gs {
 
+namespace {
+
+// buffers kept around per thread once a search is done with them
+constexpr std::size_t seen_pool_max_buffers = 8;
+
+// how many walked nodes pass between calls to graph_search_options::cancelled
+constexpr std::size_t cancel_check_interval = 256;
+
+struct seen_pool
+{
+    std::vector<graph_search_seen::buffer*> buffers;
+
+    ~seen_pool()
+    {
+        for (graph_search_seen::buffer* buf : buffers) {
+            delete buf;
+        }
+    }
+};
+
+thread_local seen_pool pool;
+
+bool graph_search_pruned(
+    const token_details* token,
+    const graph_node_id id,
+    const graph_search_options& options
+) {
+    if (options.trusted_height > 0 && token->heights[id] <= options.trusted_height) {
+        return true;
+    }
+
+    if (options.exclude_filter && options.exclude_filter->contains(token->txids[id])) {
+        return true;
+    }
+
+    return false;
+}
+
+// adds an edge from the last (still open) row of token to input_txid,
+// looked up in token first and then in the parent layer token
+void link_input(
+    token_details& token,
+    const token_details* parent_token,
+    const gs::txid& input_txid
+) {
+    const auto node_search = token.nodes.find(input_txid);
+    if (node_search != token.nodes.end()) {
+        // spending multiple outputs of the same tx only needs one edge
+        const auto row_begin = token.inputs.begin() + token.input_offsets.back();
+        if (std::find(row_begin, token.inputs.end(), node_search->second) == token.inputs.end()) {
+            token.inputs.push_back(node_search->second);
+        }
+        return;
+    }
+
+    if (parent_token == nullptr) {
+        // spdlog::warn("insert_token_data: input_txid not found in tokengraph {}", input_txid.decompress(true));
+        return;
+    }
+
+    const auto parent_search = parent_token->nodes.find(input_txid);
+    if (parent_search != parent_token->nodes.end()) {
+        const auto row_begin = token.parent_inputs.begin() + token.parent_input_offsets.back();
+        if (std::find(row_begin, token.parent_inputs.end(), parent_search->second) == token.parent_inputs.end()) {
+            token.parent_inputs.push_back(parent_search->second);
+        }
+    }
+}
+
+// records that spender spends input, on the spent node in token or else in the parent layer
+void link_spend(
+    token_details& token,
+    const token_details* parent_token,
+    const gs::outpoint& input,
+    const graph_node_id spender
+) {
+    const auto node_search = token.nodes.find(input.txid);
+    if (node_search != token.nodes.end()) {
+        token.add_spend(token.spends_head[node_search->second], spender, input.vout);
+        return;
+    }
+
+    if (parent_token == nullptr) {
+        return;
+    }
+
+    const auto parent_search = parent_token->nodes.find(input.txid);
+    if (parent_search != parent_token->nodes.end()) {
+        token.add_spend(token.parent_spends_head.emplace(parent_search->second, no_spend).first->second, spender, input.vout);
+    }
+}
+
+// depth first walk from the nodes on the stack, which are already seen and visited
+// inputs which live in the parent layer are collected into parent_roots
+// stops early when seen runs out of budget, the stack is left empty either way
+void graph_search_walk(
+    const token_details* token,
+    graph_search_seen& seen,
+    graph_search_seen::token_marks& token_seen,
+    const graph_node_visitor* visitor,
+    const graph_search_options& options,
+    std::vector<graph_node_id>& parent_roots
+) {
+    std::vector<graph_node_id>& stack = token_seen.stack();
+
+    while (! stack.empty()) {
+        const graph_node_id node = stack.back();
+        stack.pop_back();
+
+        for (auto it = token->inputs_begin(node); it != token->inputs_end(node); ++it) {
+            if (! token_seen.insert(*it)) {
+                continue;
+            }
+
+            if (graph_search_pruned(token, *it, options)) {
+                continue;
+            }
+
+            if (! seen.charge(options, visitor ? token->txdata_size(*it) : 0)) {
+                stack.clear();
+                return;
+            }
+
+            stack.push_back(*it);
+            if (visitor) {
+                (*visitor)(token, *it);
+            }
+        }
+
+        parent_roots.insert(parent_roots.end(), token->parent_inputs_begin(node), token->parent_inputs_end(node));
+    }
+}
+
+// same as graph_search_walk but follows spenders instead of inputs
+// every visited node is collected so the child layer can continue from them
+void descendant_search_walk(
+    const token_details* token,
+    graph_search_seen& seen,
+    graph_search_seen::token_marks& token_seen,
+    const graph_search_visitor& visitor,
+    const graph_search_options& options,
+    std::vector<graph_node_id>& visited
+) {
+    std::vector<graph_node_id>& stack = token_seen.stack();
+
+    while (! stack.empty()) {
+        const graph_node_id node = stack.back();
+        stack.pop_back();
+
+        for (std::uint32_t e = token->spends_head[node]; e != no_spend; e = token->spends[e].next) {
+            const graph_node_id spender = token->spends[e].node;
+            if (! token_seen.insert(spender)) {
+                continue;
+            }
+
+            if (graph_search_pruned(token, spender, options)) {
+                continue;
+            }
+
+            if (! seen.charge(options, token->txdata_size(spender))) {
+                stack.clear();
+                return;
+            }
+
+            stack.push_back(spender);
+            visited.push_back(spender);
+            visitor(token->txdata_begin(spender), token->txdata_size(spender));
+        }
+    }
+}
+
+}
+
+graph_search_seen::~graph_search_seen()
+{
+    for (auto & lease : leases) {
+        if (pool.buffers.size() < seen_pool_max_buffers) {
+            pool.buffers.push_back(lease.second);
+        } else {
+            delete lease.second;
+        }
+    }
+}
+
+graph_search_seen::token_marks graph_search_seen::get(const std::shared_ptr<token_details>& token)
+{
+    buffer* buf = nullptr;
+
+    for (auto & lease : leases) {
+        if (lease.first == token) {
+            buf = lease.second;
+            break;
+        }
+    }
+
+    if (buf == nullptr) {
+        if (pool.buffers.empty()) {
+            buf = new buffer();
+        } else {
+            buf = pool.buffers.back();
+            pool.buffers.pop_back();
+        }
+
+        // stamps left over from an earlier lease are all below the new epoch
+        // once the epoch wraps around they have to be wiped
+        if (++buf->epoch == 0) {
+            std::fill(buf->stamps.begin(), buf->stamps.end(), 0);
+            buf->epoch = 1;
+        }
+
+        leases.emplace_back(token, buf);
+    }
+
+    // token may have grown since the lease was taken
+    if (buf->stamps.size() < token->size()) {
+        buf->stamps.resize(token->size(), 0);
+    }
+
+    return token_marks(buf);
+}
+
+bool graph_search_seen::charge(const graph_search_options& options, const std::size_t size)
+{
+    if (aborted()) {
+        return false;
+    }
+
+    ++nodes;
+    bytes += size;
+
+    if ((options.max_nodes > 0 && nodes > options.max_nodes)
+     || (options.max_bytes > 0 && bytes > options.max_bytes)
+    ) {
+        abort_status = graph_search_status::LIMIT_EXCEEDED;
+        return false;
+    }
+
+    if (options.cancelled && nodes % cancel_check_interval == 0 && options.cancelled()) {
+        abort_status = graph_search_status::CANCELLED;
+        return false;
+    }
+
+    return true;
+}
+
 void txgraph::clear()
 {
-    boost::shared_lock<boost::shared_mutex> lock(lookup_mtx);
+    boost::lock_guard<boost::shared_mutex> lock(lookup_mtx);
 
     tokens.clear();
     txid_to_token.clear();
+    ++generation;
+    ++epoch;
 }
 
 bool txgraph::build_exclusion_set(
     const gs::txid lookup_txid,
-    absl::flat_hash_set<const graph_node*>& seen
+    graph_search_seen& seen,
+    const graph_search_options& limits
 ) {
-    boost::shared_lock<boost::shared_mutex> lock(lookup_mtx);
-
-    if (txid_to_token.count(lookup_txid) == 0) {
+    if (seen.aborted()) {
         return false;
     }
 
-    token_details* token = txid_to_token[lookup_txid];
-    if (token->graph.count(lookup_txid) == 0) {
+    const std::shared_ptr<token_details> token = find_token(lookup_txid);
+    if (! token) {
         return false;
     }
 
-    seen.insert(&token->graph[lookup_txid]);
-    std::stack<const graph_node*> stack;
-    stack.push(&token->graph[lookup_txid]);
+    graph_search_options options;
+    options.cancelled = limits.cancelled;
+    options.max_nodes = limits.max_nodes;
+    options.max_bytes = limits.max_bytes;
 
-    do {
-        const graph_node* node = stack.top();
-        stack.pop();
+    std::vector<graph_node_id> parent_roots;
+    {
+        boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+        const auto node_search = token->nodes.find(lookup_txid);
+        if (node_search == token->nodes.end()) {
+            return false;
+        }
 
-        for (const graph_node* n : node->inputs) {
-            if (! seen.count(n)) {
-                seen.insert(n);
-                stack.push(n);
-            }
+        graph_search_seen::token_marks token_seen = seen.get(token);
+        if (! token_seen.insert(node_search->second)) {
+            return true;
+        }
+
+        if (! seen.charge(options, 0)) {
+            return false;
         }
-    } while(! stack.empty());
+
+        std::vector<graph_node_id>& stack = token_seen.stack();
+        stack.clear();
+        stack.push_back(node_search->second);
+
+        graph_search_walk(token.get(), seen, token_seen, nullptr, options, parent_roots);
+    }
+
+    search_parent_layer(token->tokenid, parent_roots, seen, nullptr, options);
+
+    return ! seen.aborted();
+}
+
+bool txgraph::mark_seen(
+    const gs::txid txid,
+    graph_search_seen& seen
+) {
+    const std::shared_ptr<token_details> token = find_token(txid);
+    if (! token) {
+        return false;
+    }
+
+    boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+    const auto node_search = token->nodes.find(txid);
+    if (node_search == token->nodes.end()) {
+        return false;
+    }
+
+    seen.get(token).insert(node_search->second);
 
     return true;
 }
 
-graph_search_response txgraph::graph_search__ptr(
+graph_search_status txgraph::graph_search(
     const gs::txid lookup_txid,
-    absl::flat_hash_set<const graph_node*>& seen
+    graph_search_seen& seen,
+    const graph_search_visitor& visitor,
+    const graph_search_options& options
 ) {
-    boost::shared_lock<boost::shared_mutex> lock(lookup_mtx);
+    return graph_search_nodes(lookup_txid, seen,
+        [&visitor](const token_details* token, const graph_node_id id) {
+            visitor(token->txdata_begin(id), token->txdata_size(id));
+        },
+        options
+    );
+}
 
-    if (txid_to_token.count(lookup_txid) == 0) {
+graph_search_status txgraph::graph_search_nodes(
+    const gs::txid lookup_txid,
+    graph_search_seen& seen,
+    const graph_node_visitor& visitor,
+    const graph_search_options& options
+) {
+    if (seen.aborted()) {
+        return seen.status();
+    }
+
+    const std::shared_ptr<token_details> token = find_token(lookup_txid);
+    if (! token) {
         // txid hasn't entered our system yet
-        return { graph_search_status::NOT_FOUND, {} };
+        return graph_search_status::NOT_FOUND;
+    }
+
+    std::vector<graph_node_id> parent_roots;
+    {
+        boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+        const auto node_search = token->nodes.find(lookup_txid);
+        if (node_search == token->nodes.end()) {
+            return graph_search_status::NOT_IN_TOKENGRAPH;
+        }
+
+        graph_search_seen::token_marks token_seen = seen.get(token);
+        if (! token_seen.insert(node_search->second)) {
+            return graph_search_status::OK;
+        }
+
+        if (options.prune_lookup && graph_search_pruned(token.get(), node_search->second, options)) {
+            return graph_search_status::OK;
+        }
+
+        if (! seen.charge(options, token->txdata_size(node_search->second))) {
+            return seen.status();
+        }
+
+        visitor(token.get(), node_search->second);
+
+        std::vector<graph_node_id>& stack = token_seen.stack();
+        stack.clear();
+        stack.push_back(node_search->second);
+
+        graph_search_walk(token.get(), seen, token_seen, &visitor, options, parent_roots);
     }
 
-    token_details* token = txid_to_token[lookup_txid];
-    if (token->graph.count(lookup_txid) == 0) {
-        return { graph_search_status::NOT_IN_TOKENGRAPH, {} };
+    // the token lock is released first, a parent layer never waits on its children
+    search_parent_layer(token->tokenid, parent_roots, seen, &visitor, options);
+
+    return seen.status();
+}
+
+void txgraph::search_parent_layer(
+    const gs::tokenid& tokenid,
+    const std::vector<graph_node_id>& roots,
+    graph_search_seen& seen,
+    const graph_node_visitor* visitor,
+    const graph_search_options& options
+) {
+    if (roots.empty() || parent == nullptr || seen.aborted()) {
+        return;
+    }
+
+    const std::shared_ptr<token_details> token = parent->find_token(tokenid);
+    if (! token) {
+        return;
     }
 
-    seen.insert(&token->graph[lookup_txid]);
-    std::stack<const graph_node*> stack;
-    stack.push(&token->graph[lookup_txid]);
-    std::vector<std::vector<std::uint8_t>> ret = { token->graph[lookup_txid].txdata };
+    std::vector<graph_node_id> parent_roots;
+    {
+        boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+
+        graph_search_seen::token_marks token_seen = seen.get(token);
+        std::vector<graph_node_id>& stack = token_seen.stack();
+        stack.clear();
+
+        for (const graph_node_id root : roots) {
+            if (! token_seen.insert(root)) {
+                continue;
+            }
+
+            if (graph_search_pruned(token.get(), root, options)) {
+                continue;
+            }
 
-    do {
-        const graph_node* node = stack.top();
-        stack.pop();
+            if (! seen.charge(options, visitor ? token->txdata_size(root) : 0)) {
+                stack.clear();
+                break;
+            }
 
-        for (const graph_node* n : node->inputs) {
-            if (! seen.count(n)) {
-                seen.insert(n);
-                stack.push(n);
-                ret.push_back(n->txdata);
+            if (visitor) {
+                (*visitor)(token.get(), root);
             }
+            stack.push_back(root);
         }
-    } while(! stack.empty());
 
-    return { graph_search_status::OK, ret };
+        graph_search_walk(token.get(), seen, token_seen, visitor, options, parent_roots);
+    }
+
+    parent->search_parent_layer(tokenid, parent_roots, seen, visitor, options);
 }
 
-unsigned txgraph::insert_token_data (
-    const gs::tokenid & tokenid,
-    const std::vector<gs::transaction> & txs
+graph_search_response txgraph::graph_search__ptr(
+    const gs::txid lookup_txid,
+    graph_search_seen& seen,
+    const graph_search_options& options
 ) {
-    boost::lock_guard<boost::shared_mutex> lock(lookup_mtx);
+    std::vector<std::vector<std::uint8_t>> ret;
+    const graph_search_status status = graph_search(lookup_txid, seen,
+        [&ret](const std::uint8_t* txdata, const std::size_t size) {
+            ret.emplace_back(txdata, txdata + size);
+        },
+        options
+    );
+
+    return { status, std::move(ret) };
+}
+
+graph_search_status txgraph::graph_search_ordered(
+    const gs::txid lookup_txid,
+    graph_search_seen& seen,
+    graph_search_ordered_result& result,
+    const graph_search_options& options
+) {
+    // the search only ever moves down into parent layers, so tokens are
+    // met in layer order and a node's parent inputs live in the next token
+    struct found_node
+    {
+        std::uint32_t       layer;
+        graph_node_id       id;
+        const std::uint8_t* txdata;
+        std::size_t         size;
+        std::uint32_t       inputs_begin;        // local inputs are edges[inputs_begin, parent_inputs_begin)
+        std::uint32_t       parent_inputs_begin; // parent layer inputs run up to the next node's inputs_begin
+    };
+
+    std::vector<const token_details*> layers;
+    std::vector<found_node> found;
+    std::vector<graph_node_id> edges;
 
-    if (tokens.count(tokenid) == 0) {
-        tokens.emplace(tokenid, tokenid);
+    const graph_search_status status = graph_search_nodes(lookup_txid, seen,
+        [&](const token_details* token, const graph_node_id id) {
+            if (layers.empty() || layers.back() != token) {
+                layers.push_back(token);
+            }
+
+            found_node node;
+            node.layer        = static_cast<std::uint32_t>(layers.size() - 1);
+            node.id           = id;
+            node.txdata       = token->txdata_begin(id);
+            node.size         = token->txdata_size(id);
+            node.inputs_begin = static_cast<std::uint32_t>(edges.size());
+            edges.insert(edges.end(), token->inputs_begin(id), token->inputs_end(id));
+            node.parent_inputs_begin = static_cast<std::uint32_t>(edges.size());
+            edges.insert(edges.end(), token->parent_inputs_begin(id), token->parent_inputs_end(id));
+
+            found.push_back(node);
+        },
+        options
+    );
+
+    if (status != graph_search_status::OK || found.empty()) {
+        return status;
     }
 
-    token_details& token = tokens[tokenid];
+    const std::uint32_t n = static_cast<std::uint32_t>(found.size());
 
-    absl::flat_hash_map<std::vector<std::uint8_t>, std::vector<gs::txid>> input_map;
+    std::vector<absl::flat_hash_map<graph_node_id, std::uint32_t>> indices(layers.size());
+    for (std::uint32_t i=0; i<n; ++i) {
+        indices[found[i].layer].emplace(found[i].id, i);
+    }
 
-    unsigned ret = 0;
+    // inputs which are not part of the result (excluded or pruned) are dropped
+    std::vector<std::uint32_t> adj_offsets({ 0 });
+    std::vector<std::uint32_t> adj;
+    adj_offsets.reserve(n + 1);
+    for (std::uint32_t i=0; i<n; ++i) {
+        const found_node& node = found[i];
+        const std::uint32_t edges_end = i+1 < n ? found[i+1].inputs_begin : static_cast<std::uint32_t>(edges.size());
 
-    // first pass to populate graph nodes
-    std::vector<graph_node*> latest;
-    latest.reserve(txs.size());
+        for (std::uint32_t e = node.inputs_begin; e < edges_end; ++e) {
+            const std::uint32_t layer = e < node.parent_inputs_begin ? node.layer : node.layer + 1;
+            if (layer >= indices.size()) {
+                continue;
+            }
+
+            const auto index_search = indices[layer].find(edges[e]);
+            if (index_search != indices[layer].end()) {
+                adj.push_back(index_search->second);
+            }
+        }
 
-    for (const auto & tx : txs) {
-        // spdlog::info("insert_token_data: txid {}", tx.txid.decompress(true));
-        if (txid_to_token.count(tx.txid)) {
-            spdlog::warn("insert_token_data: already in set {}", tx.txid.decompress(true));
+        adj_offsets.push_back(static_cast<std::uint32_t>(adj.size()));
+    }
+
+    // depth first post order puts every node after its inputs
+    constexpr std::uint32_t unplaced = std::numeric_limits<std::uint32_t>::max();
+    std::vector<std::uint32_t> position(n, unplaced);
+    std::vector<std::uint32_t> next_edge(adj_offsets.begin(), adj_offsets.end() - 1);
+    std::vector<bool> entered(n, false);
+    std::vector<std::uint32_t> order;
+    std::vector<std::uint32_t> stack;
+    order.reserve(n);
+
+    for (std::uint32_t root=0; root<n; ++root) {
+        if (entered[root]) {
             continue;
         }
 
-        token.graph.emplace(std::piecewise_construct,
-            std::forward_as_tuple(tx.txid),
-            std::forward_as_tuple(tx.serialized)
-        );
-        txid_to_token.emplace(tx.txid, &token);
+        entered[root] = true;
+        stack.push_back(root);
 
-        std::vector<gs::txid> inputs;
-        inputs.reserve(tx.inputs.size());
-        std::transform(
-            tx.inputs.begin(),
-            tx.inputs.end(),
-            std::back_inserter(inputs),
-            [](const gs::outpoint& outpoint) -> gs::txid {
-                return outpoint.txid;
+        while (! stack.empty()) {
+            const std::uint32_t top = stack.back();
+            if (next_edge[top] < adj_offsets[top+1]) {
+                const std::uint32_t input = adj[next_edge[top]++];
+                if (! entered[input]) {
+                    entered[input] = true;
+                    stack.push_back(input);
+                }
+                continue;
             }
-        );
 
-        input_map.emplace(tx.serialized, inputs);
-        latest.push_back(&token.graph[tx.txid]);
-        ++ret;
+            stack.pop_back();
+            position[top] = static_cast<std::uint32_t>(result.txdata.size() + order.size());
+            order.push_back(top);
+        }
+    }
+
+    result.txdata.reserve(result.txdata.size() + n);
+    for (const std::uint32_t i : order) {
+        result.txdata.emplace_back(found[i].txdata, found[i].size);
+
+        const std::size_t row_begin = result.parents.size();
+        for (std::uint32_t e = adj_offsets[i]; e < adj_offsets[i+1]; ++e) {
+            result.parents.push_back(position[adj[e]]);
+        }
+        std::sort(result.parents.begin() + row_begin, result.parents.end());
+
+        result.parent_offsets.push_back(static_cast<std::uint32_t>(result.parents.size()));
+    }
+
+    return status;
+}
+
+graph_search_status txgraph::descendant_search(
+    const gs::txid lookup_txid,
+    graph_search_seen& seen,
+    const graph_search_visitor& visitor,
+    const graph_search_options& options
+) {
+    const std::shared_ptr<token_details> token = find_token(lookup_txid);
+    if (! token) {
+        return graph_search_status::NOT_FOUND;
+    }
+
+    std::vector<graph_node_id> visited;
+    {
+        boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+        const auto node_search = token->nodes.find(lookup_txid);
+        if (node_search == token->nodes.end()) {
+            return graph_search_status::NOT_IN_TOKENGRAPH;
+        }
+
+        graph_search_seen::token_marks token_seen = seen.get(token);
+        if (! token_seen.insert(node_search->second)) {
+            return graph_search_status::OK;
+        }
+
+        if (options.prune_lookup && graph_search_pruned(token.get(), node_search->second, options)) {
+            return graph_search_status::OK;
+        }
+
+        if (! seen.charge(options, token->txdata_size(node_search->second))) {
+            return seen.status();
+        }
+
+        visitor(token->txdata_begin(node_search->second), token->txdata_size(node_search->second));
+
+        std::vector<graph_node_id>& stack = token_seen.stack();
+        stack.clear();
+        stack.push_back(node_search->second);
+        visited.push_back(node_search->second);
+
+        descendant_search_walk(token.get(), seen, token_seen, visitor, options, visited);
+    }
+
+    // same as with parents, the lock is released before moving on to the child layer
+    search_child_layer(token->tokenid, visited, seen, visitor, options);
+
+    return seen.status();
+}
 
-        // std::cout << "txid:\t" << tx.txid.decompress(true) << "\n";
+void txgraph::search_child_layer(
+    const gs::tokenid& tokenid,
+    const std::vector<graph_node_id>& parent_nodes,
+    graph_search_seen& seen,
+    const graph_search_visitor& visitor,
+    const graph_search_options& options
+) {
+    if (parent_nodes.empty() || child == nullptr || seen.aborted()) {
+        return;
     }
 
-    // second pass to add inputs
-    for (graph_node * node : latest) {
-        for (const gs::txid & input_txid : input_map[node->txdata]) {
-            if (! token.graph.count(input_txid)) {
-                // spdlog::warn("insert_token_data: input_txid not found in tokengraph {}", input_txid.decompress(true));
+    const std::shared_ptr<token_details> token = child->find_token(tokenid);
+    if (! token) {
+        return;
+    }
+
+    std::vector<graph_node_id> visited;
+    {
+        boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+
+        graph_search_seen::token_marks token_seen = seen.get(token);
+        std::vector<graph_node_id>& stack = token_seen.stack();
+        stack.clear();
+
+        for (const graph_node_id parent_node : parent_nodes) {
+            const auto head_search = token->parent_spends_head.find(parent_node);
+            if (head_search == token->parent_spends_head.end()) {
                 continue;
             }
 
-            node->inputs.push_back(&token.graph[input_txid]);
+            for (std::uint32_t e = head_search->second; e != no_spend; e = token->spends[e].next) {
+                const graph_node_id spender = token->spends[e].node;
+                if (! token_seen.insert(spender)) {
+                    continue;
+                }
+
+                if (graph_search_pruned(token.get(), spender, options)) {
+                    continue;
+                }
+
+                if (! seen.charge(options, token->txdata_size(spender))) {
+                    break;
+                }
+
+                visitor(token->txdata_begin(spender), token->txdata_size(spender));
+                stack.push_back(spender);
+                visited.push_back(spender);
+            }
+
+            if (seen.aborted()) {
+                stack.clear();
+                break;
+            }
+        }
+
+        descendant_search_walk(token.get(), seen, token_seen, visitor, options, visited);
+    }
+
+    child->search_child_layer(tokenid, visited, seen, visitor, options);
+}
+
+graph_search_response txgraph::descendant_search__ptr(
+    const gs::txid lookup_txid,
+    graph_search_seen& seen,
+    const graph_search_options& options
+) {
+    std::vector<std::vector<std::uint8_t>> ret;
+    const graph_search_status status = descendant_search(lookup_txid, seen,
+        [&ret](const std::uint8_t* txdata, const std::size_t size) {
+            ret.emplace_back(txdata, txdata + size);
+        },
+        options
+    );
+
+    return { status, std::move(ret) };
+}
+
+graph_search_status txgraph::graph_search_estimate(
+    const gs::txid lookup_txid,
+    graph_search_estimate_result& result
+) {
+    const std::shared_ptr<token_details> token = find_token(lookup_txid);
+    if (! token) {
+        return graph_search_status::NOT_FOUND;
+    }
+
+    boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+    const auto node_search = token->nodes.find(lookup_txid);
+    if (node_search == token->nodes.end()) {
+        return graph_search_status::NOT_IN_TOKENGRAPH;
+    }
+
+    const gs::ancestor_sketch& sketch = token->sketches[node_search->second];
+    result.ancestors = sketch.count();
+    result.bytes     = sketch.bytes();
+
+    return graph_search_status::OK;
+}
+
+bool txgraph::find_spender(
+    const gs::outpoint& outpoint,
+    gs::txid& spender
+) {
+    const std::shared_ptr<token_details> token = find_token(outpoint.txid);
+    if (! token) {
+        return false;
+    }
+
+    graph_node_id id;
+    {
+        boost::shared_lock<boost::shared_mutex> token_lock(token->mtx);
+        const auto node_search = token->nodes.find(outpoint.txid);
+        if (node_search == token->nodes.end()) {
+            return false;
+        }
+
+        id = node_search->second;
+        for (std::uint32_t e = token->spends_head[id]; e != no_spend; e = token->spends[e].next) {
+            if (token->spends[e].vout == outpoint.vout) {
+                spender = token->txids[token->spends[e].node];
+                return true;
+            }
+        }
+    }
+
+    if (child == nullptr) {
+        return false;
+    }
+
+    const std::shared_ptr<token_details> child_token = child->find_token(token->tokenid);
+    if (! child_token) {
+        return false;
+    }
+
+    boost::shared_lock<boost::shared_mutex> child_lock(child_token->mtx);
+    const auto head_search = child_token->parent_spends_head.find(id);
+    if (head_search == child_token->parent_spends_head.end()) {
+        return false;
+    }
+
+    for (std::uint32_t e = head_search->second; e != no_spend; e = child_token->spends[e].next) {
+        if (child_token->spends[e].vout == outpoint.vout) {
+            spender = child_token->txids[child_token->spends[e].node];
+            return true;
         }
     }
 
+    return false;
+}
+
+unsigned txgraph::insert_token_data (
+    const gs::tokenid & tokenid,
+    const std::vector<gs::transaction> & txs,
+    const std::uint32_t height
+) {
+    std::shared_ptr<token_details> token_ptr;
+    {
+        boost::lock_guard<boost::shared_mutex> lock(lookup_mtx);
+
+        std::shared_ptr<token_details>& slot = tokens[tokenid];
+        if (! slot) {
+            slot = std::make_shared<token_details>(store, tokenid);
+        }
+        token_ptr = slot;
+    }
+
+    token_details& token = *token_ptr;
+    std::vector<gs::txid> inserted;
+
+    // inputs which are not in this layer are linked to the parent layer
+    const std::shared_ptr<token_details> parent_token = parent ? parent->find_token(tokenid) : nullptr;
+
+    {
+        boost::lock_guard<boost::shared_mutex> token_lock(token.mtx);
+        boost::shared_lock<boost::shared_mutex> parent_lock;
+        if (parent_token) {
+            parent_lock = boost::shared_lock<boost::shared_mutex>(parent_token->mtx);
+        }
+
+        // first pass to populate graph nodes
+        std::vector<const gs::transaction*> latest;
+        latest.reserve(txs.size());
+
+        for (const auto & tx : txs) {
+            // spdlog::info("insert_token_data: txid {}", tx.txid.decompress(true));
+            if (token.nodes.count(tx.txid)) {
+                spdlog::warn("insert_token_data: already in set {}", tx.txid.decompress(true));
+                continue;
+            }
+
+            gs::tx_handle handle;
+            if (! store.acquire(tx.txid, tx.serialized.data(), tx.serialized.size(), handle)) {
+                continue;
+            }
+
+            token.nodes.emplace(tx.txid, static_cast<graph_node_id>(token.size()));
+            token.txids.push_back(tx.txid);
+            token.heights.push_back(height);
+            token.txdata.push_back(handle);
+            token.spends_head.push_back(no_spend);
+
+            latest.push_back(&tx);
+            inserted.push_back(tx.txid);
+        }
+
+        // second pass to add inputs, csr rows must be appended in node order
+        graph_node_id spender = static_cast<graph_node_id>(token.size() - latest.size());
+        for (const gs::transaction * tx : latest) {
+            for (const gs::outpoint & input : tx->inputs) {
+                link_input(token, parent_token.get(), input.txid);
+                link_spend(token, parent_token.get(), input, spender);
+            }
+
+            token.input_offsets.push_back(token.inputs.size());
+            token.parent_input_offsets.push_back(token.parent_inputs.size());
+            token.update_sketch(spender, parent_token.get());
+            ++spender;
+        }
+    }
+
+    if (inserted.empty()) {
+        return 0;
+    }
+
+    // txids only become searchable once their token is complete
+    {
+        boost::lock_guard<boost::shared_mutex> lock(lookup_mtx);
+
+        for (const gs::txid & txid : inserted) {
+            txid_to_token.emplace(txid, &token);
+        }
+    }
+
+    ++generation;
+
+    return inserted.size();
+}
+
+unsigned txgraph::remove_token_data (
+    const std::vector<gs::txid> & txids
+) {
+    absl::flat_hash_map<std::shared_ptr<token_details>, absl::flat_hash_set<gs::txid>> affected;
+    for (const gs::txid & txid : txids) {
+        const std::shared_ptr<token_details> token = find_token(txid);
+        if (token) {
+            affected[token].insert(txid);
+        }
+    }
+
+    unsigned ret = 0;
+
+    for (const auto & m : affected) {
+        const token_details& old_token = *m.first;
+        const absl::flat_hash_set<gs::txid>& removed = m.second;
+
+        // searches still holding the old token keep using it untouched
+        std::shared_ptr<token_details> token = std::make_shared<token_details>(store, old_token.tokenid);
+        const std::shared_ptr<token_details> parent_token = parent ? parent->find_token(old_token.tokenid) : nullptr;
+        {
+            boost::shared_lock<boost::shared_mutex> token_lock(m.first->mtx);
+            boost::shared_lock<boost::shared_mutex> parent_lock;
+            if (parent_token) {
+                parent_lock = boost::shared_lock<boost::shared_mutex>(parent_token->mtx);
+            }
+
+            std::vector<graph_node_id> remap(old_token.size());
+            std::vector<bool> kept(old_token.size(), false);
+            for (graph_node_id id=0; id<old_token.size(); ++id) {
+                if (removed.count(old_token.txids[id])) {
+                    continue;
+                }
+
+                kept[id] = true;
+
+                // the old token holds a reference until it is dropped so this cannot fail
+                store.acquire(old_token.txids[id]);
+
+                remap[id] = static_cast<graph_node_id>(token->size());
+                token->nodes.emplace(old_token.txids[id], remap[id]);
+                token->txids.push_back(old_token.txids[id]);
+                token->heights.push_back(old_token.heights[id]);
+                token->txdata.push_back(old_token.txdata[id]);
+
+                token->parent_inputs.insert(token->parent_inputs.end(), old_token.parent_inputs_begin(id), old_token.parent_inputs_end(id));
+
+                // inputs which were just confirmed now live in the parent layer
+                for (auto it = old_token.inputs_begin(id); it != old_token.inputs_end(id); ++it) {
+                    if (removed.count(old_token.txids[*it])) {
+                        link_input(*token, parent_token.get(), old_token.txids[*it]);
+                    } else {
+                        token->inputs.push_back(remap[*it]);
+                    }
+                }
+
+                token->input_offsets.push_back(token->inputs.size());
+                token->parent_input_offsets.push_back(token->parent_inputs.size());
+
+                // ancestors may have been dropped as well so this is not a copy
+                token->update_sketch(remap[id], parent_token.get());
+            }
+
+            // spends of nodes which were just confirmed move to the parent layer
+            token->spends_head.assign(token->size(), no_spend);
+            for (graph_node_id id=0; id<old_token.size(); ++id) {
+                std::uint32_t* head = nullptr;
+                if (kept[id]) {
+                    head = &token->spends_head[remap[id]];
+                } else if (parent_token) {
+                    const auto parent_search = parent_token->nodes.find(old_token.txids[id]);
+                    if (parent_search != parent_token->nodes.end()) {
+                        head = &token->parent_spends_head.emplace(parent_search->second, no_spend).first->second;
+                    }
+                }
+
+                if (head == nullptr) {
+                    continue;
+                }
+
+                for (std::uint32_t e = old_token.spends_head[id]; e != no_spend; e = old_token.spends[e].next) {
+                    const spend_edge& edge = old_token.spends[e];
+                    if (kept[edge.node]) {
+                        token->add_spend(*head, remap[edge.node], edge.vout);
+                    }
+                }
+            }
+
+            for (const auto & head : old_token.parent_spends_head) {
+                for (std::uint32_t e = head.second; e != no_spend; e = old_token.spends[e].next) {
+                    const spend_edge& edge = old_token.spends[e];
+                    if (kept[edge.node]) {
+                        token->add_spend(token->parent_spends_head.emplace(head.first, no_spend).first->second, remap[edge.node], edge.vout);
+                    }
+                }
+            }
+        }
+
+        boost::lock_guard<boost::shared_mutex> lock(lookup_mtx);
+
+        for (const gs::txid & txid : removed) {
+            txid_to_token.erase(txid);
+        }
+
+        if (token->size() == 0) {
+            tokens.erase(token->tokenid);
+        } else {
+            for (const gs::txid & txid : token->txids) {
+                txid_to_token[txid] = token.get();
+            }
+            tokens[token->tokenid] = token;
+        }
+
+        ret += removed.size();
+    }
+
+    if (ret > 0) {
+        ++generation;
+        ++epoch;
+    }
+
     return ret;
 }
 
+std::shared_ptr<token_details> txgraph::find_token(const gs::tokenid & tokenid)
+{
+    boost::shared_lock<boost::shared_mutex> lock(lookup_mtx);
+
+    const auto tokens_search = tokens.find(tokenid);
+    if (tokens_search == tokens.end()) {
+        return nullptr;
+    }
+
+    return tokens_search->second;
+}
+
+std::shared_ptr<token_details> txgraph::find_token(const gs::txid & txid)
+{
+    boost::shared_lock<boost::shared_mutex> lock(lookup_mtx);
+
+    const auto token_search = txid_to_token.find(txid);
+    if (token_search == txid_to_token.end()) {
+        return nullptr;
+    }
+
+    const auto tokens_search = tokens.find(token_search->second->tokenid);
+    if (tokens_search == tokens.end()) {
+        return nullptr;
+    }
+
+    return tokens_search->second;
+}
+
 }
@@ -0,0 +1,296 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <limits>
+
+#include <spdlog/spdlog.h>
+
+#include <gs++/bhash.hpp>
+#include <gs++/token_details.hpp>
+#include <gs++/txgraph.hpp>
+#include <gs++/txgraph_snapshot.hpp>
+#include <gs++/snapshot_io.hpp>
+
+namespace gs {
+
+constexpr std::uint32_t txgraph_snapshot::version;
+
+namespace {
+
+constexpr char snapshot_magic[8] = { 'G', 'S', 'T', 'X', 'G', 'R', 'P', 'H' };
+static_assert(sizeof(spend_edge) == 12, "spend edges are written as three uint32");
+static_assert(sizeof(ancestor_sketch) == 36, "sketches are written as 32 registers and a float");
+
+// a token read from the image which does not hold store references yet
+// handles are relative to the start of the body
+struct snapshot_token
+{
+    std::shared_ptr<token_details> token;
+    std::vector<gs::txid>          txids;
+    std::vector<gs::tx_handle>     handles;
+};
+
+// arrays come straight from the image so every offset and edge is checked before use
+// transaction bytes stay in the mapping, see txgraph_snapshot::load
+bool read_snapshot_token(snapshot_reader& reader, const std::uint8_t* body, snapshot_token& ret)
+{
+    token_details& token = *ret.token;
+
+    std::uint64_t n_nodes;
+    std::uint64_t n_txdata;
+    std::uint64_t n_inputs;
+    std::uint64_t n_spends;
+    std::vector<gs::txid>& txids = ret.txids;
+    std::vector<std::uint64_t> txdata_offsets;
+
+    if (! reader.read(token.tokenid.data(), token.tokenid.size())
+     || ! reader.read_u64(n_nodes)
+     || ! reader.read_u64(n_txdata)
+     || ! reader.read_u64(n_inputs)
+     || ! reader.read_u64(n_spends)
+     || n_nodes  > std::numeric_limits<graph_node_id>::max()
+     || n_spends >= no_spend
+     || ! reader.read_vector(txids, n_nodes)
+     || ! reader.read_vector(token.heights, n_nodes)
+     || ! reader.read_vector(txdata_offsets, n_nodes + 1)
+     || ! reader.read_vector(token.input_offsets, n_nodes + 1)
+     || ! reader.read_vector(token.inputs, n_inputs)
+     || ! reader.read_vector(token.spends_head, n_nodes)
+     || ! reader.read_vector(token.spends, n_spends)
+     || ! reader.read_vector(token.sketches, n_nodes)
+    ) {
+        return false;
+    }
+
+    const std::uint8_t* txdata = reader.view(n_txdata);
+    if (txdata == nullptr || ! reader.pad()) {
+        return false;
+    }
+
+    if (txdata_offsets.front()      != 0 || txdata_offsets.back()      != n_txdata
+     || token.input_offsets.front() != 0 || token.input_offsets.back() != n_inputs
+    ) {
+        return false;
+    }
+
+    for (std::size_t i=0; i<n_nodes; ++i) {
+        if (txdata_offsets[i]      > txdata_offsets[i+1]
+         || token.input_offsets[i] > token.input_offsets[i+1]
+        ) {
+            return false;
+        }
+    }
+
+    for (const graph_node_id input : token.inputs) {
+        if (input >= n_nodes) {
+            return false;
+        }
+    }
+
+    // lists must only point backwards so walking them always ends
+    for (const std::uint32_t head : token.spends_head) {
+        if (head != no_spend && head >= n_spends) {
+            return false;
+        }
+    }
+
+    for (std::size_t i=0; i<n_spends; ++i) {
+        if (token.spends[i].node >= n_nodes
+         || (token.spends[i].next != no_spend && token.spends[i].next >= i)
+        ) {
+            return false;
+        }
+    }
+
+    token.parent_input_offsets.assign(n_nodes + 1, 0);
+    token.parent_inputs.clear();
+
+    // a transaction larger than a chunk could never have been stored
+    token.nodes.reserve(n_nodes);
+    ret.handles.reserve(n_nodes);
+    for (std::size_t i=0; i<n_nodes; ++i) {
+        const std::uint64_t size = txdata_offsets[i+1] - txdata_offsets[i];
+        if (size > tx_store::chunk_size
+         || ! token.nodes.emplace(txids[i], static_cast<graph_node_id>(i)).second
+        ) {
+            return false;
+        }
+
+        ret.handles.emplace_back((txdata - body) + txdata_offsets[i], static_cast<std::uint32_t>(size));
+    }
+
+    return true;
+}
+
+}
+
+bool txgraph_snapshot::save(
+    const std::string& path,
+    txgraph& g,
+    const absl::flat_hash_set<gs::txid>& valid
+) {
+    if (g.parent != nullptr) {
+        spdlog::error("txgraph snapshot: only the bottom layer can be saved");
+        return false;
+    }
+
+    std::vector<std::shared_ptr<token_details>> tokens;
+    std::vector<gs::txid> saved_valid;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(g.lookup_mtx);
+        tokens.reserve(g.tokens.size());
+        for (const auto & it : g.tokens) {
+            tokens.push_back(it.second);
+        }
+
+        // valid txids without a node would never be validated again once loaded
+        for (const gs::txid & txid : valid) {
+            if (g.txid_to_token.count(txid)) {
+                saved_valid.push_back(txid);
+            }
+        }
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    snapshot_writer writer(tmp_path);
+    if (! writer.out) {
+        spdlog::error("txgraph snapshot: could not open {}", tmp_path);
+        return false;
+    }
+
+    // body is checksummed as it is written, header is filled in last
+    writer.write_u64(tokens.size());
+    for (const auto & token_ptr : tokens) {
+        const token_details& token = *token_ptr;
+        boost::shared_lock<boost::shared_mutex> token_lock(token_ptr->mtx);
+
+        // bytes are gathered out of the store into one run per token
+        std::vector<std::uint64_t> txdata_offsets({ 0 });
+        txdata_offsets.reserve(token.size() + 1);
+        for (const gs::tx_handle & handle : token.txdata) {
+            txdata_offsets.push_back(txdata_offsets.back() + handle.size);
+        }
+
+        writer.write(token.tokenid.data(), token.tokenid.size());
+        writer.write_u64(token.size());
+        writer.write_u64(txdata_offsets.back());
+        writer.write_u64(token.inputs.size());
+        writer.write_u64(token.spends.size());
+        writer.write_vector(token.txids);
+        writer.write_vector(token.heights);
+        writer.write_vector(txdata_offsets);
+        writer.write_vector(token.input_offsets);
+        writer.write_vector(token.inputs);
+        writer.write_vector(token.spends_head);
+        writer.write_vector(token.spends);
+        writer.write_vector(token.sketches);
+        for (const gs::tx_handle & handle : token.txdata) {
+            writer.write(token.store.data(handle), handle.size);
+        }
+        writer.pad();
+    }
+
+    writer.write_u64(saved_valid.size());
+    writer.write_vector(saved_valid);
+    writer.pad();
+
+    if (! writer.finish(snapshot_magic, version, height, block_hash, tmp_path, path, "txgraph snapshot")) {
+        return false;
+    }
+
+    spdlog::info("txgraph snapshot: saved {} tokens at height {} to {}", tokens.size(), height, path);
+    return true;
+}
+
+bool txgraph_snapshot::load(
+    const std::string& path,
+    txgraph& g,
+    absl::flat_hash_set<gs::txid>& valid
+) {
+    const std::shared_ptr<const snapshot_mapping> mapping = std::make_shared<const snapshot_mapping>(path);
+    snapshot_header header;
+    if (! mapping->check(snapshot_magic, version, path, "txgraph snapshot", header)) {
+        return false;
+    }
+
+    const std::uint8_t* body = mapping->data + snapshot_header_size;
+    snapshot_reader reader(body, header.body_size);
+
+    std::uint64_t n_tokens;
+    if (! reader.read_u64(n_tokens) || n_tokens > header.body_size / (32 + 4*sizeof(std::uint64_t))) {
+        spdlog::error("txgraph snapshot: {} is malformed", path);
+        return false;
+    }
+
+    std::vector<snapshot_token> image_tokens(n_tokens);
+    absl::flat_hash_set<gs::tokenid> tokenids;
+
+    for (snapshot_token & t : image_tokens) {
+        t.token = std::make_shared<token_details>(g.store);
+        if (! read_snapshot_token(reader, body, t) || ! tokenids.insert(t.token->tokenid).second) {
+            spdlog::error("txgraph snapshot: {} is malformed", path);
+            return false;
+        }
+    }
+
+    std::uint64_t n_valid;
+    std::vector<gs::txid> valid_txids;
+    if (! reader.read_u64(n_valid)
+     || ! reader.read_vector(valid_txids, n_valid)
+     || ! reader.pad()
+     || ! reader.done()
+    ) {
+        spdlog::error("txgraph snapshot: {} is malformed", path);
+        return false;
+    }
+
+    // the store serves txdata straight out of the mapping from here on,
+    // so a restored graph only costs the pages which are actually read
+    std::uint64_t base;
+    if (! g.store.add_region(body, header.body_size, mapping, base)) {
+        return false;
+    }
+
+    absl::flat_hash_map<gs::tokenid, std::shared_ptr<token_details>> tokens;
+    absl::flat_hash_map<gs::txid,    token_details*>                 txid_to_token;
+    tokens.reserve(image_tokens.size());
+
+    // txids only go into a token once they hold a store reference
+    for (snapshot_token & t : image_tokens) {
+        token_details& token = *t.token;
+        token.txids.reserve(t.txids.size());
+        token.txdata.reserve(t.txids.size());
+
+        for (std::size_t i=0; i<t.txids.size(); ++i) {
+            gs::tx_handle handle(base + t.handles[i].offset, t.handles[i].size);
+            if (! g.store.acquire_region(t.txids[i], handle)) {
+                return false;
+            }
+
+            token.txids.push_back(t.txids[i]);
+            token.txdata.push_back(handle);
+            txid_to_token.emplace(t.txids[i], t.token.get());
+        }
+
+        tokens.emplace(token.tokenid, std::move(t.token));
+    }
+
+    valid.insert(valid_txids.begin(), valid_txids.end());
+
+    {
+        boost::lock_guard<boost::shared_mutex> lock(g.lookup_mtx);
+        g.tokens        = std::move(tokens);
+        g.txid_to_token = std::move(txid_to_token);
+        ++g.generation;
+        ++g.epoch;
+    }
+
+    height = header.height;
+    std::memcpy(block_hash.data(), header.block_hash, sizeof(header.block_hash));
+
+    spdlog::info("txgraph snapshot: loaded {} tokens at height {} from {}", n_tokens, height, path);
+    return true;
+}
+
+}
@@ -12,11 +12,15 @@
 #include <catch2/catch.hpp>
 
 #include <gs++/txgraph.hpp>
+#include <gs++/graph_search_cache.hpp>
+#include <gs++/txgraph_snapshot.hpp>
+#include <gs++/tx_store.hpp>
 #include <gs++/scriptpubkey.hpp>
 #include <gs++/util.hpp>
 #include <gs++/slpdb.hpp>
 #include <gs++/slp_transaction.hpp>
 #include <gs++/slp_validator.hpp>
+#include <gs++/slp_validator_snapshot.hpp>
 #include <gs++/bch.hpp>
 
 
@@ -30,6 +34,984 @@ TEST_CASE( "create_txgraph is 1 (pass)", "[single-file]" ) {
     REQUIRE( create_txgraph() == 1 );
 }
 
+// fake transaction with only the fields txgraph cares about
+// txdata is just the id repeated so results are easy to check
+gs::transaction make_graph_tx(const std::uint8_t id, const std::vector<std::uint8_t> & parents)
+{
+    gs::transaction tx;
+    tx.txid.v[0] = id;
+    tx.serialized = std::vector<std::uint8_t>(id, id);
+    for (const std::uint8_t parent : parents) {
+        gs::txid parent_txid;
+        parent_txid.v[0] = parent;
+        tx.inputs.emplace_back(parent_txid, 1);
+        tx.inputs.emplace_back(parent_txid, 2);
+    }
+
+    return tx;
+}
+
+gs::txid graph_txid(const std::uint8_t id)
+{
+    gs::txid txid;
+    txid.v[0] = id;
+    return txid;
+}
+
+std::vector<std::uint8_t> graph_search_ids(const gs::graph_search_response & result)
+{
+    std::vector<std::uint8_t> ret;
+    for (const auto & m : result.second) {
+        ret.push_back(m.size() > 0 ? m[0] : 0);
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+TEST_CASE( "txgraph_search", "[single-file]" ) {
+    //   1   2
+    //   |\ /
+    //   3 4    5 (other token)
+    //    \|
+    //     6
+    gs::txgraph g;
+    gs::tokenid tokenid;
+    tokenid.v[0] = 1;
+    gs::tokenid other_tokenid;
+    other_tokenid.v[0] = 5;
+
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(1, {}), make_graph_tx(2, {}) }) == 2 );
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(3, { 1 }), make_graph_tx(4, { 1, 2 }) }) == 2 );
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(6, { 3, 4 }) }) == 1 );
+    REQUIRE( g.insert_token_data(other_tokenid, { make_graph_tx(5, { 2 }) }) == 1 );
+    // duplicates are skipped
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(6, { 3, 4 }) }) == 0 );
+
+    const gs::token_details & token = *g.tokens.at(tokenid);
+    REQUIRE( token.size() == 5 );
+    REQUIRE( token.txdata_size(4) == 6 );
+    REQUIRE( token.txdata_begin(4)[0] == 6 );
+    // inputs spending two outputs of the same tx collapse into one edge
+    REQUIRE( token.inputs.size() == 5 );
+
+    SECTION ("\tfull search") {
+        gs::graph_search_seen seen;
+        const gs::graph_search_response result = g.graph_search__ptr(graph_txid(6), seen);
+        REQUIRE( result.first == gs::graph_search_status::OK );
+        REQUIRE( graph_search_ids(result) == std::vector<std::uint8_t>({ 1, 2, 3, 4, 6 }) );
+    }
+
+    SECTION ("\tsearch with exclusion") {
+        gs::graph_search_seen seen;
+        REQUIRE( g.build_exclusion_set(graph_txid(3), seen) );
+        const gs::graph_search_response result = g.graph_search__ptr(graph_txid(6), seen);
+        REQUIRE( result.first == gs::graph_search_status::OK );
+        REQUIRE( graph_search_ids(result) == std::vector<std::uint8_t>({ 2, 4, 6 }) );
+    }
+
+    SECTION ("\tsearch limits") {
+        gs::graph_search_options options;
+        options.max_bytes = 6 + 4 + 3 + 2 + 1;
+        gs::graph_search_seen seen;
+        REQUIRE( g.graph_search__ptr(graph_txid(6), seen, options).first == gs::graph_search_status::OK );
+
+        options.max_bytes -= 1;
+        gs::graph_search_seen seen2;
+        REQUIRE( g.graph_search__ptr(graph_txid(6), seen2, options).first == gs::graph_search_status::LIMIT_EXCEEDED );
+        // an aborted seen set stays aborted
+        REQUIRE( g.graph_search__ptr(graph_txid(5), seen2).first == gs::graph_search_status::LIMIT_EXCEEDED );
+
+        // exclusions are walked on the same budget
+        gs::graph_search_options node_options;
+        node_options.max_nodes = 3;
+        gs::graph_search_seen seen3;
+        REQUIRE( g.build_exclusion_set(graph_txid(3), seen3, node_options) );
+        REQUIRE( g.graph_search__ptr(graph_txid(6), seen3, node_options).first == gs::graph_search_status::LIMIT_EXCEEDED );
+        REQUIRE( ! g.build_exclusion_set(graph_txid(4), seen3, node_options) );
+    }
+
+    SECTION ("\tcancelled search") {
+        gs::graph_search_options options;
+        options.cancelled = []() { return true; };
+        gs::graph_search_seen seen;
+        // too few nodes to ever poll
+        REQUIRE( g.graph_search__ptr(graph_txid(6), seen, options).first == gs::graph_search_status::OK );
+
+        gs::txgraph chain;
+        std::vector<gs::transaction> txs({ make_graph_tx(1, {}) });
+        for (int i=2; i<256; ++i) {
+            txs.push_back(make_graph_tx(static_cast<std::uint8_t>(i), { static_cast<std::uint8_t>(i-1) }));
+        }
+        gs::transaction tip = make_graph_tx(1, { 255 });
+        tip.txid.v[1] = 1;
+        txs.push_back(tip);
+        REQUIRE( chain.insert_token_data(tokenid, txs) == 256 );
+
+        gs::graph_search_seen chain_seen;
+        REQUIRE( chain.graph_search__ptr(tip.txid, chain_seen, options).first == gs::graph_search_status::CANCELLED );
+        gs::graph_search_seen descendants_seen;
+        REQUIRE( chain.descendant_search__ptr(graph_txid(1), descendants_seen, options).first == gs::graph_search_status::CANCELLED );
+    }
+
+    SECTION ("\tsearch estimates") {
+        gs::graph_search_estimate_result estimate;
+        REQUIRE( g.graph_search_estimate(graph_txid(1), estimate) == gs::graph_search_status::OK );
+        REQUIRE( estimate.ancestors == Approx(1).epsilon(0.05) );
+        REQUIRE( estimate.bytes == Approx(1).epsilon(0.05) );
+
+        REQUIRE( g.graph_search_estimate(graph_txid(6), estimate) == gs::graph_search_status::OK );
+        REQUIRE( estimate.ancestors == Approx(5).epsilon(0.2) );
+        REQUIRE( estimate.bytes == Approx(6 + 4 + 3 + 2 + 1).epsilon(0.25) );
+
+        REQUIRE( g.graph_search_estimate(graph_txid(7), estimate) == gs::graph_search_status::NOT_FOUND );
+
+        // a long chain is well past where registers fill up
+        gs::txgraph chain;
+        std::vector<gs::transaction> txs({ make_graph_tx(1, {}) });
+        for (int i=2; i<256; ++i) {
+            txs.push_back(make_graph_tx(static_cast<std::uint8_t>(i), { static_cast<std::uint8_t>(i-1) }));
+        }
+        REQUIRE( chain.insert_token_data(tokenid, txs) == 255 );
+        REQUIRE( chain.graph_search_estimate(graph_txid(255), estimate) == gs::graph_search_status::OK );
+        REQUIRE( estimate.ancestors == Approx(255).epsilon(0.4) );
+        REQUIRE( estimate.bytes == Approx(255 * 256 / 2).epsilon(0.4) );
+    }
+
+    SECTION ("\tedges do not cross tokens") {
+        gs::graph_search_seen seen;
+        const gs::graph_search_response result = g.graph_search__ptr(graph_txid(5), seen);
+        REQUIRE( graph_search_ids(result) == std::vector<std::uint8_t>({ 5 }) );
+    }
+
+    SECTION ("\tsearches do not wait on other tokens") {
+        boost::lock_guard<boost::shared_mutex> lock(g.tokens.at(tokenid)->mtx);
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(5), seen)) == std::vector<std::uint8_t>({ 5 }) );
+    }
+
+    SECTION ("\tremoving nodes") {
+        REQUIRE( g.remove_token_data({ graph_txid(3), graph_txid(5), graph_txid(7) }) == 2 );
+        REQUIRE( g.tokens.count(other_tokenid) == 0 );
+        REQUIRE( g.tokens.at(tokenid)->size() == 4 );
+
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(6), seen)) == std::vector<std::uint8_t>({ 1, 2, 4, 6 }) );
+        REQUIRE( g.graph_search__ptr(graph_txid(3), seen).first == gs::graph_search_status::NOT_FOUND );
+        gs::graph_search_seen descendants_seen;
+        REQUIRE( graph_search_ids(g.descendant_search__ptr(graph_txid(1), descendants_seen)) == std::vector<std::uint8_t>({ 1, 4, 6 }) );
+        REQUIRE( g.graph_search__ptr(graph_txid(5), seen).first == gs::graph_search_status::NOT_FOUND );
+
+        // removed nodes can be inserted again
+        REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(3, { 1 }) }) == 1 );
+        gs::graph_search_seen seen2;
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(3), seen2)) == std::vector<std::uint8_t>({ 1, 3 }) );
+    }
+
+    SECTION ("\tdescendant search") {
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(g.descendant_search__ptr(graph_txid(1), seen)) == std::vector<std::uint8_t>({ 1, 3, 4, 6 }) );
+        gs::graph_search_seen seen2;
+        REQUIRE( graph_search_ids(g.descendant_search__ptr(graph_txid(2), seen2)) == std::vector<std::uint8_t>({ 2, 4, 6 }) );
+        REQUIRE( g.descendant_search__ptr(graph_txid(7), seen2).first == gs::graph_search_status::NOT_FOUND );
+
+        gs::graph_search_options options;
+        options.max_bytes = 1 + 3 + 4 + 6;
+        gs::graph_search_seen seen3;
+        REQUIRE( g.descendant_search__ptr(graph_txid(1), seen3, options).first == gs::graph_search_status::OK );
+        options.max_bytes -= 1;
+        gs::graph_search_seen seen4;
+        REQUIRE( g.descendant_search__ptr(graph_txid(1), seen4, options).first == gs::graph_search_status::LIMIT_EXCEEDED );
+
+        // spenders already held by the client are not visited or searched past
+        gs::txid_filter filter(std::vector<std::uint8_t>(64, 0), 3, 7);
+        filter.insert(graph_txid(3));
+        gs::graph_search_options filter_options;
+        filter_options.exclude_filter = &filter;
+        gs::graph_search_seen seen5;
+        REQUIRE( graph_search_ids(g.descendant_search__ptr(graph_txid(1), seen5, filter_options)) == std::vector<std::uint8_t>({ 1, 4, 6 }) );
+    }
+
+    SECTION ("\tspenders by outpoint") {
+        gs::txid spender;
+        REQUIRE( g.find_spender(gs::outpoint(graph_txid(3), 2), spender) );
+        REQUIRE( spender == graph_txid(6) );
+        REQUIRE( ! g.find_spender(gs::outpoint(graph_txid(3), 3), spender) );
+        REQUIRE( ! g.find_spender(gs::outpoint(graph_txid(6), 1), spender) );
+
+        // spends are kept per token, 5 is not linked to 2
+        REQUIRE( g.find_spender(gs::outpoint(graph_txid(2), 1), spender) );
+        REQUIRE( spender == graph_txid(4) );
+    }
+
+    SECTION ("\tmissing txid") {
+        gs::graph_search_seen seen;
+        REQUIRE( g.graph_search__ptr(graph_txid(7), seen).first == gs::graph_search_status::NOT_FOUND );
+        REQUIRE( ! g.build_exclusion_set(graph_txid(7), seen) );
+    }
+
+    SECTION ("\tlookups sharing a seen set") {
+        gs::graph_search_seen seen;
+        std::vector<std::uint8_t> ids;
+        for (const std::uint8_t id : { 3, 4, 5 }) {
+            const std::vector<std::uint8_t> r = graph_search_ids(g.graph_search__ptr(graph_txid(id), seen));
+            ids.insert(ids.end(), r.begin(), r.end());
+        }
+        std::sort(ids.begin(), ids.end());
+        REQUIRE( ids == std::vector<std::uint8_t>({ 1, 2, 3, 4, 5 }) );
+    }
+
+    SECTION ("\tsearch with exclude filter") {
+        gs::txid_filter filter(std::vector<std::uint8_t>(64, 0), 3, 7);
+        filter.insert(graph_txid(4));
+        filter.insert(graph_txid(6));
+
+        gs::graph_search_options options;
+        options.exclude_filter = &filter;
+
+        // 4 is pruned along with 2 which is only reachable through it
+        // the lookup txid itself is always returned
+        gs::graph_search_seen seen;
+        const gs::graph_search_response result = g.graph_search__ptr(graph_txid(6), seen, options);
+        REQUIRE( result.first == gs::graph_search_status::OK );
+        REQUIRE( graph_search_ids(result) == std::vector<std::uint8_t>({ 1, 3, 6 }) );
+    }
+
+    SECTION ("\tpooled seen sets start empty") {
+        for (int i=0; i<3; ++i) {
+            gs::graph_search_seen seen;
+            REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(6), seen)) == std::vector<std::uint8_t>({ 1, 2, 3, 4, 6 }) );
+        }
+
+        // token grows while a seen set is held
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(3), seen)) == std::vector<std::uint8_t>({ 1, 3 }) );
+        REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(8, { 6 }) }) == 1 );
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(8), seen)) == std::vector<std::uint8_t>({ 2, 4, 6, 8 }) );
+    }
+}
+
+TEST_CASE( "txgraph_trusted_search", "[single-file]" ) {
+    //   1   2    height 10
+    //   |\ /
+    //   3 4      height 11
+    //    \|
+    //     6      mempool
+    gs::txgraph g;
+    gs::tokenid tokenid;
+    tokenid.v[0] = 1;
+
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(1, {}), make_graph_tx(2, {}) }, 10) == 2 );
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(3, { 1 }), make_graph_tx(4, { 1, 2 }) }, 11) == 2 );
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(6, { 3, 4 }) }) == 1 );
+    REQUIRE( g.tokens.at(tokenid)->heights.back() == gs::unconfirmed_height );
+
+    SECTION ("\ttrusted height") {
+        gs::graph_search_options options;
+        options.trusted_height = 10;
+
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(6), seen, options)) == std::vector<std::uint8_t>({ 3, 4, 6 }) );
+    }
+
+    SECTION ("\ttrusted height prunes the lookup only when asked") {
+        gs::graph_search_options options;
+        options.trusted_height = 11;
+
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(4), seen, options)) == std::vector<std::uint8_t>({ 4 }) );
+
+        options.prune_lookup = true;
+        gs::graph_search_seen seen2;
+        const gs::graph_search_response result = g.graph_search__ptr(graph_txid(4), seen2, options);
+        REQUIRE( result.first == gs::graph_search_status::OK );
+        REQUIRE( result.second.empty() );
+    }
+
+    SECTION ("\ttrusted checkpoint") {
+        gs::graph_search_seen seen;
+        REQUIRE( g.mark_seen(graph_txid(4), seen) );
+        REQUIRE( ! g.mark_seen(graph_txid(7), seen) );
+        // 1 is still reached through 3
+        REQUIRE( graph_search_ids(g.graph_search__ptr(graph_txid(6), seen)) == std::vector<std::uint8_t>({ 1, 3, 6 }) );
+    }
+}
+
+TEST_CASE( "txgraph_layers", "[single-file]" ) {
+    //   1   2    confirmed
+    //   |   |
+    //   3   |    mempool
+    //    \ /
+    //     4      mempool
+    gs::txgraph g;
+    gs::txgraph mg(&g);
+    gs::tokenid tokenid;
+    tokenid.v[0] = 1;
+
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(1, {}), make_graph_tx(2, {}) }, 10) == 2 );
+    REQUIRE( mg.insert_token_data(tokenid, { make_graph_tx(3, { 1 }), make_graph_tx(4, { 3, 2 }) }) == 2 );
+    REQUIRE( mg.tokens.at(tokenid)->parent_inputs.size() == 2 );
+
+    SECTION ("\tsearch crosses into the parent layer") {
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(mg.graph_search__ptr(graph_txid(4), seen)) == std::vector<std::uint8_t>({ 1, 2, 3, 4 }) );
+        // confirmed ancestors were marked in the same seen set
+        REQUIRE( g.graph_search__ptr(graph_txid(1), seen).second.empty() );
+
+        gs::graph_search_estimate_result estimate;
+        REQUIRE( mg.graph_search_estimate(graph_txid(4), estimate) == gs::graph_search_status::OK );
+        REQUIRE( estimate.ancestors == Approx(4).epsilon(0.2) );
+    }
+
+    SECTION ("\tpruning applies to the parent layer") {
+        gs::graph_search_options options;
+        options.trusted_height = 10;
+
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(mg.graph_search__ptr(graph_txid(4), seen, options)) == std::vector<std::uint8_t>({ 3, 4 }) );
+    }
+
+    SECTION ("\texclusion crosses into the parent layer") {
+        gs::graph_search_seen seen;
+        REQUIRE( mg.build_exclusion_set(graph_txid(3), seen) );
+        REQUIRE( graph_search_ids(mg.graph_search__ptr(graph_txid(4), seen)) == std::vector<std::uint8_t>({ 2, 4 }) );
+    }
+
+    SECTION ("\tconfirming a mempool parent relinks its children") {
+        REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(3, { 1 }) }, 11) == 1 );
+        REQUIRE( mg.remove_token_data({ graph_txid(3) }) == 1 );
+        REQUIRE( mg.tokens.at(tokenid)->size() == 1 );
+
+        gs::graph_search_seen seen;
+        REQUIRE( mg.graph_search__ptr(graph_txid(3), seen).first == gs::graph_search_status::NOT_FOUND );
+        REQUIRE( graph_search_ids(mg.graph_search__ptr(graph_txid(4), seen)) == std::vector<std::uint8_t>({ 1, 2, 3, 4 }) );
+
+        gs::txid spender;
+        REQUIRE( g.find_spender(gs::outpoint(graph_txid(3), 1), spender) );
+        REQUIRE( spender == graph_txid(4) );
+        gs::graph_search_seen descendants_seen;
+        REQUIRE( graph_search_ids(g.descendant_search__ptr(graph_txid(1), descendants_seen)) == std::vector<std::uint8_t>({ 1, 3, 4 }) );
+    }
+
+    SECTION ("\tordered search puts inputs first across layers") {
+        gs::graph_search_seen seen;
+        gs::graph_search_ordered_result result;
+        REQUIRE( mg.graph_search_ordered(graph_txid(4), seen, result) == gs::graph_search_status::OK );
+        REQUIRE( result.txdata.size() == 4 );
+        REQUIRE( result.parent_offsets.size() == 5 );
+
+        std::vector<std::uint8_t> ids;
+        for (const auto & m : result.txdata) {
+            ids.push_back(m.first[0]);
+        }
+        const auto position = [&ids](const std::uint8_t id) {
+            return static_cast<std::uint32_t>(std::find(ids.begin(), ids.end(), id) - ids.begin());
+        };
+
+        REQUIRE( position(1) < position(3) );
+        REQUIRE( position(2) < position(4) );
+        REQUIRE( position(3) < position(4) );
+
+        const std::uint32_t n4 = position(4);
+        std::vector<std::uint32_t> parents4(result.parents.begin() + result.parent_offsets[n4],
+                                            result.parents.begin() + result.parent_offsets[n4+1]);
+        std::vector<std::uint32_t> expected({ position(2), position(3) });
+        std::sort(expected.begin(), expected.end());
+        REQUIRE( parents4 == expected );
+
+        // excluded inputs are left out of the table
+        gs::graph_search_seen excluded;
+        REQUIRE( mg.build_exclusion_set(graph_txid(3), excluded) );
+        gs::graph_search_ordered_result partial;
+        REQUIRE( mg.graph_search_ordered(graph_txid(4), excluded, partial) == gs::graph_search_status::OK );
+        REQUIRE( partial.txdata.size() == 2 );
+        REQUIRE( partial.txdata[0].first[0] == 2 );
+        REQUIRE( partial.parents == std::vector<std::uint32_t>({ 0 }) );
+    }
+
+    SECTION ("\tdescendants cross into the child layer") {
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(g.descendant_search__ptr(graph_txid(1), seen)) == std::vector<std::uint8_t>({ 1, 3, 4 }) );
+        gs::graph_search_seen seen2;
+        REQUIRE( graph_search_ids(mg.descendant_search__ptr(graph_txid(3), seen2)) == std::vector<std::uint8_t>({ 3, 4 }) );
+
+        // the child layer shares the budget
+        gs::graph_search_options options;
+        options.max_nodes = 2;
+        gs::graph_search_seen seen3;
+        REQUIRE( g.descendant_search__ptr(graph_txid(1), seen3, options).first == gs::graph_search_status::LIMIT_EXCEEDED );
+
+        gs::txid spender;
+        REQUIRE( g.find_spender(gs::outpoint(graph_txid(2), 2), spender) );
+        REQUIRE( spender == graph_txid(4) );
+        REQUIRE( mg.find_spender(gs::outpoint(graph_txid(3), 1), spender) );
+        REQUIRE( spender == graph_txid(4) );
+    }
+}
+
+TEST_CASE( "txid_filter", "[single-file]" ) {
+    gs::txid_filter filter(std::vector<std::uint8_t>(128, 0), 5, 0xabcdef);
+    REQUIRE( ! filter.empty() );
+    REQUIRE( gs::txid_filter().empty() );
+
+    std::vector<gs::txid> txids;
+    for (int i=0; i<50; ++i) {
+        gs::txid txid;
+        for (unsigned j=0; j<txid.v.size(); ++j) {
+            txid.v[j] = static_cast<std::uint8_t>(i * 31 + j * 17);
+        }
+        txids.push_back(txid);
+        filter.insert(txid);
+    }
+
+    for (const gs::txid & txid : txids) {
+        REQUIRE( filter.contains(txid) );
+    }
+
+    REQUIRE( ! gs::txid_filter(std::vector<std::uint8_t>(128, 0), 5, 0).contains(txids[0]) );
+}
+
+TEST_CASE( "graph_search_cache", "[single-file]" ) {
+    gs::graph_search_cache cache(10);
+    std::shared_ptr<const gs::graph_search_cache::reply_txdata> reply;
+    const std::uint64_t no_mempool = gs::graph_search_cache::no_mempool;
+
+    SECTION ("\texclusion order does not matter") {
+        cache.put(graph_txid(1), { graph_txid(2), graph_txid(3) }, 1, no_mempool, { "ab", "c" });
+        REQUIRE( cache.get(graph_txid(1), { graph_txid(3), graph_txid(2) }, 1, 5, reply) );
+        REQUIRE( *reply == gs::graph_search_cache::reply_txdata({ "ab", "c" }) );
+        REQUIRE( ! cache.get(graph_txid(1), { graph_txid(2) }, 1, 5, reply) );
+        REQUIRE( ! cache.get(graph_txid(2), { graph_txid(2), graph_txid(3) }, 1, 5, reply) );
+    }
+
+    SECTION ("\tmempool replies expire with the generation") {
+        cache.put(graph_txid(1), {}, 1, 5, { "abc" });
+        REQUIRE( cache.get(graph_txid(1), {}, 1, 5, reply) );
+        REQUIRE( ! cache.get(graph_txid(1), {}, 1, 6, reply) );
+        REQUIRE( cache.size() == 0 );
+    }
+
+    SECTION ("\tconfirmed replies expire with the confirmed epoch") {
+        cache.put(graph_txid(1), {}, 1, no_mempool, { "abc" });
+        REQUIRE( cache.get(graph_txid(1), {}, 1, 6, reply) );
+        REQUIRE( ! cache.get(graph_txid(1), {}, 2, 6, reply) );
+        REQUIRE( cache.size() == 0 );
+    }
+
+    SECTION ("\tconfirmed replies survive blocks which only add nodes") {
+        gs::txgraph g;
+        gs::tokenid tokenid;
+        tokenid.v[0] = 1;
+        gs::tokenid other_tokenid;
+        other_tokenid.v[0] = 2;
+        REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(1, {}), make_graph_tx(2, { 1 }) }) == 2 );
+        cache.put(graph_txid(2), {}, g.epoch, no_mempool, { "ab" });
+
+        REQUIRE( g.insert_token_data(other_tokenid, { make_graph_tx(3, {}) }) == 1 );
+        REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(4, { 2 }) }) == 1 );
+        REQUIRE( cache.get(graph_txid(2), {}, g.epoch, 1, reply) );
+
+        REQUIRE( g.remove_token_data({ graph_txid(4) }) == 1 );
+        REQUIRE( ! cache.get(graph_txid(2), {}, g.epoch, 1, reply) );
+    }
+
+    SECTION ("\tleast recently used is evicted") {
+        cache.put(graph_txid(1), {}, 1, no_mempool, { "aaaa" });
+        cache.put(graph_txid(2), {}, 1, no_mempool, { "bb", "bb" });
+        REQUIRE( cache.get(graph_txid(1), {}, 1, 1, reply) );
+        cache.put(graph_txid(3), {}, 1, no_mempool, { "cccc" });
+        REQUIRE( cache.get(graph_txid(1), {}, 1, 1, reply) );
+        REQUIRE( ! cache.get(graph_txid(2), {}, 1, 1, reply) );
+        REQUIRE( cache.get(graph_txid(3), {}, 1, 1, reply) );
+
+        // too big to ever fit
+        cache.put(graph_txid(4), {}, 1, no_mempool, { "eeeeee", "eeeee" });
+        REQUIRE( ! cache.get(graph_txid(4), {}, 1, 1, reply) );
+        REQUIRE( cache.size() == 2 );
+    }
+}
+
+TEST_CASE( "tx_store", "[single-file]" ) {
+    gs::tx_store store;
+    const gs::transaction tx = make_graph_tx(3, {});
+
+    gs::tx_handle handle;
+    REQUIRE( store.acquire(tx.txid, tx.serialized.data(), tx.serialized.size(), handle) );
+    REQUIRE( store.copy(handle) == tx.serialized );
+
+    SECTION ("\tbytes are stored once across holders") {
+        gs::txgraph g(nullptr, store);
+        gs::txgraph mg(&g, store);
+        gs::tokenid tokenid;
+        tokenid.v[0] = 1;
+
+        REQUIRE( g.insert_token_data(tokenid, { tx }, 10) == 1 );
+        REQUIRE( mg.insert_token_data(tokenid, { make_graph_tx(4, { 3 }) }) == 1 );
+        REQUIRE( store.size() == 2 );
+        REQUIRE( store.bytes() == 3+4 );
+        REQUIRE( g.tokens.at(tokenid)->txdata[0].offset == handle.offset );
+
+        REQUIRE( mg.remove_token_data({ graph_txid(4) }) == 1 );
+        REQUIRE( store.size() == 1 );
+    }
+
+    SECTION ("\tentries are dropped with their last reference") {
+        gs::tx_handle handle2;
+        REQUIRE( store.acquire(tx.txid, nullptr, 0, handle2) );
+        REQUIRE( handle2.offset == handle.offset );
+        REQUIRE( store.acquire(tx.txid) );
+
+        store.release(tx.txid);
+        store.release(tx.txid);
+        REQUIRE( store.find(tx.txid, handle2) );
+        store.release(tx.txid);
+        REQUIRE( ! store.find(tx.txid, handle2) );
+        REQUIRE( ! store.acquire(tx.txid) );
+    }
+
+    SECTION ("\treleased bytes are reused") {
+        const gs::transaction tx4 = make_graph_tx(4, {});
+        const gs::transaction tx5 = make_graph_tx(5, {});
+        gs::tx_handle handle4;
+        gs::tx_handle handle5;
+        REQUIRE( store.acquire(tx4.txid, tx4.serialized.data(), tx4.serialized.size(), handle4) );
+        REQUIRE( store.acquire(tx5.txid, tx5.serialized.data(), tx5.serialized.size(), handle5) );
+        REQUIRE( store.bytes() == 3+4+5 );
+
+        // neighbouring ranges are merged, 3+4 bytes fit 2 and 5 bytes
+        store.release(tx.txid);
+        store.release(tx4.txid);
+        REQUIRE( store.bytes() == 5 );
+        REQUIRE( store.free_bytes() == 3+4 );
+
+        const gs::transaction tx2 = make_graph_tx(2, {});
+        gs::tx_handle handle2;
+        REQUIRE( store.acquire(tx2.txid, tx2.serialized.data(), tx2.serialized.size(), handle2) );
+        REQUIRE( handle2.offset == handle.offset );
+        REQUIRE( store.free_bytes() == 5 );
+
+        gs::tx_handle handle5b;
+        const gs::transaction tx5b = make_graph_tx(6, {});
+        REQUIRE( store.acquire(tx5b.txid, tx5b.serialized.data(), 5, handle5b) );
+        REQUIRE( handle5b.offset == handle.offset + 2 );
+        REQUIRE( store.free_bytes() == 0 );
+        REQUIRE( store.copy(handle2) == tx2.serialized );
+        REQUIRE( store.copy(handle5) == tx5.serialized );
+
+        // the last range handed out is given back to the end instead
+        store.release(tx5.txid);
+        REQUIRE( store.free_bytes() == 0 );
+        REQUIRE( store.acquire(tx5.txid, tx5.serialized.data(), tx5.serialized.size(), handle) );
+        REQUIRE( handle.offset == handle5.offset );
+    }
+
+    SECTION ("\tregions lend their bytes without a copy") {
+        const std::vector<std::uint8_t> image({ 3, 3, 3, 8, 8 });
+        std::uint64_t base;
+        REQUIRE( store.add_region(image.data(), image.size(), nullptr, base) );
+
+        gs::tx_handle handle8(base + 3, 2);
+        REQUIRE( store.acquire_region(graph_txid(8), handle8) );
+        REQUIRE( store.data(handle8) == image.data() + 3 );
+
+        // stored transactions keep the bytes they already have
+        gs::tx_handle handle3(base, 3);
+        REQUIRE( store.acquire_region(tx.txid, handle3) );
+        REQUIRE( handle3.offset == handle.offset );
+
+        // the chunk before the region is not given up
+        gs::tx_handle handle9;
+        const gs::transaction tx9 = make_graph_tx(9, {});
+        REQUIRE( store.acquire(tx9.txid, tx9.serialized.data(), tx9.serialized.size(), handle9) );
+        REQUIRE( handle9.offset == handle.offset + 3 );
+        REQUIRE( store.copy(handle9) == tx9.serialized );
+
+        // released region bytes are not reused
+        store.release(graph_txid(8));
+        REQUIRE( store.free_bytes() == gs::tx_store::chunk_size - 3 - 9 );
+    }
+}
+
+TEST_CASE( "txgraph_snapshot", "[single-file]" ) {
+    const std::string path = "txgraph_test.snapshot";
+
+    gs::txgraph g;
+    gs::tokenid tokenid;
+    tokenid.v[0] = 1;
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(1, {}), make_graph_tx(2, {}) }, 10) == 2 );
+    REQUIRE( g.insert_token_data(tokenid, { make_graph_tx(3, { 1 }), make_graph_tx(4, { 1, 2 }) }, 11) == 2 );
+
+    gs::txgraph_snapshot saved;
+    saved.height = 11;
+    saved.block_hash.v[0] = 0xab;
+    // 5 is only in the mempool, it has no node to be validated again from
+    REQUIRE( saved.save(path, g, { graph_txid(1), graph_txid(3), graph_txid(5) }) );
+
+    SECTION ("\tround trip") {
+        gs::txgraph loaded_g;
+        absl::flat_hash_set<gs::txid> valid;
+        gs::txgraph_snapshot loaded;
+        REQUIRE( loaded.load(path, loaded_g, valid) );
+        REQUIRE( loaded.height == 11 );
+        REQUIRE( loaded.block_hash == saved.block_hash );
+        REQUIRE( valid.size() == 2 );
+        REQUIRE( valid.count(graph_txid(3)) );
+        REQUIRE( ! valid.count(graph_txid(5)) );
+        REQUIRE( loaded_g.tokens.at(tokenid)->heights == g.tokens.at(tokenid)->heights );
+
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(loaded_g.graph_search__ptr(graph_txid(4), seen)) == std::vector<std::uint8_t>({ 1, 2, 4 }) );
+
+        gs::txid spender;
+        REQUIRE( loaded_g.find_spender(gs::outpoint(graph_txid(2), 1), spender) );
+        REQUIRE( spender == graph_txid(4) );
+
+        // sketches come from the image
+        gs::graph_search_estimate_result estimate;
+        gs::graph_search_estimate_result loaded_estimate;
+        REQUIRE( g.graph_search_estimate(graph_txid(4), estimate) == gs::graph_search_status::OK );
+        REQUIRE( loaded_g.graph_search_estimate(graph_txid(4), loaded_estimate) == gs::graph_search_status::OK );
+        REQUIRE( loaded_estimate.ancestors == estimate.ancestors );
+        REQUIRE( loaded_estimate.bytes == estimate.bytes );
+    }
+
+    SECTION ("\ttxdata is served from the image") {
+        gs::tx_store store;
+        gs::txgraph loaded_g(nullptr, store);
+        absl::flat_hash_set<gs::txid> valid;
+        gs::txgraph_snapshot loaded;
+        REQUIRE( loaded.load(path, loaded_g, valid) );
+
+        // the mapping outlives the file
+        std::remove(path.c_str());
+
+        gs::graph_search_seen seen;
+        REQUIRE( graph_search_ids(loaded_g.graph_search__ptr(graph_txid(4), seen)) == std::vector<std::uint8_t>({ 1, 2, 4 }) );
+
+        gs::tx_handle handle;
+        REQUIRE( store.find(graph_txid(2), handle) );
+        REQUIRE( store.copy(handle) == make_graph_tx(2, {}).serialized );
+    }
+
+    SECTION ("\tcorrupt images are rejected") {
+        {
+            std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+            f.seekp(100);
+            f.put(0x7f);
+        }
+
+        gs::txgraph loaded_g;
+        absl::flat_hash_set<gs::txid> valid;
+        gs::txgraph_snapshot loaded;
+        REQUIRE( ! loaded.load(path, loaded_g, valid) );
+        REQUIRE( loaded_g.tokens.empty() );
+        REQUIRE( valid.empty() );
+    }
+
+    std::remove(path.c_str());
+}
+
+
+// minimal slp transaction of a single token, enough for slp_validator
+gs::transaction make_slp_tx(
+    const std::uint8_t id,
+    const gs::slp_transaction& slp,
+    const std::vector<gs::outpoint>& inputs
+) {
+    gs::transaction tx;
+    tx.txid.v[0] = id;
+    tx.serialized = std::vector<std::uint8_t>(id, id);
+    tx.inputs = inputs;
+    tx.slp = slp;
+    tx.slp.tokenid.v[0] = 1;
+    tx.slp.token_type = 1;
+    tx.outputs.resize(3); // room for a baton at vout 2
+    return tx;
+}
+
+TEST_CASE( "slp_validator_invalid_cache", "[single-file]" ) {
+    // genesis 1 -> send 2 -> send 3
+    gs::slp_validator validator;
+    const gs::transaction genesis = make_slp_tx(1, gs::slp_transaction(gs::slp_transaction_genesis("T", "T", "", "", 0, false, 0, 100)), {});
+    const gs::transaction send    = make_slp_tx(2, gs::slp_transaction(gs::slp_transaction_send({ 60 })), { gs::outpoint(graph_txid(1), 1) });
+    const gs::transaction resend  = make_slp_tx(3, gs::slp_transaction(gs::slp_transaction_send({ 50 })), { gs::outpoint(graph_txid(2), 1) });
+    const gs::transaction spam    = make_slp_tx(4, gs::slp_transaction(gs::slp_transaction_send({ 1000 })), { gs::outpoint(graph_txid(1), 1), gs::outpoint(graph_txid(9), 0) });
+
+    // input is not known yet, missing inputs are not indexed
+    REQUIRE( ! validator.add_tx(send, false) );
+    REQUIRE( validator.has_invalid(send.txid) );
+    REQUIRE( validator.invalid.at(send.txid) == gs::slp_invalid_reason::send_inputs );
+    REQUIRE( validator.invalid_spenders.empty() );
+
+    REQUIRE( ! validator.add_tx(resend, false) );
+    REQUIRE( validator.invalid_spenders.at(send.txid) == std::vector<gs::txid>({ resend.txid }) );
+
+    REQUIRE( validator.add_tx(genesis, false) );
+    REQUIRE( ! validator.add_tx(spam, false) );
+    REQUIRE( validator.has_invalid(spam.txid) );
+    REQUIRE( ! validator.validate(spam.txid) );
+    // the bch funding input of spam never becomes valid
+    REQUIRE( validator.invalid_spenders.count(graph_txid(9)) == 0 );
+
+    // send becoming valid (confirmed by a trusted block) lets its spender be looked at again
+    REQUIRE( ! validator.add_tx(send, true) );
+    REQUIRE( validator.has_valid(send.txid) );
+    REQUIRE( ! validator.has_invalid(resend.txid) );
+    REQUIRE( validator.invalid_spenders.count(send.txid) == 0 );
+    REQUIRE( validator.validate(resend.txid) );
+    REQUIRE( validator.has_valid(resend.txid) );
+
+    // spam does not spend anything which changed
+    REQUIRE( validator.has_invalid(spam.txid) );
+    REQUIRE( validator.remove_tx(spam.txid) );
+    REQUIRE( ! validator.has_invalid(spam.txid) );
+    REQUIRE( validator.invalid_spenders.empty() );
+}
+
+TEST_CASE( "slp_validator_mint", "[single-file]" ) {
+    // genesis 1 -baton-> mint 2 -baton-> mint 3, mint 4 spends no baton
+    gs::slp_validator validator;
+    const gs::transaction genesis = make_slp_tx(1, gs::slp_transaction(gs::slp_transaction_genesis("T", "T", "", "", 0, true, 2, 100)), {});
+    const gs::transaction mint    = make_slp_tx(2, gs::slp_transaction(gs::slp_transaction_mint(true, 2, 10)), { gs::outpoint(graph_txid(1), 2) });
+    const gs::transaction remint  = make_slp_tx(3, gs::slp_transaction(gs::slp_transaction_mint(true, 2, 10)), { gs::outpoint(graph_txid(2), 2) });
+    const gs::transaction stray   = make_slp_tx(4, gs::slp_transaction(gs::slp_transaction_mint(true, 2, 10)), { gs::outpoint(graph_txid(2), 1) });
+
+    REQUIRE( validator.add_tx(genesis, false) );
+    REQUIRE( validator.add_tx(mint, false) );
+    REQUIRE( validator.add_tx(remint, false) );
+    REQUIRE( ! validator.add_tx(stray, false) );
+    REQUIRE( validator.invalid.at(stray.txid) == gs::slp_invalid_reason::mint_baton );
+
+    const gs::slp_record* record = validator.find(mint.txid);
+    REQUIRE( record == &validator.records.at(mint.txid) );
+    REQUIRE( record->tokenid == mint.slp.tokenid );
+    REQUIRE( record->type == gs::slp_transaction_type::mint );
+    REQUIRE( record->mint_baton_vout == 2 );
+    REQUIRE( record->output_slp_amount(1) == 10 );
+    REQUIRE( record->output_slp_amount(2) == 0 );
+    REQUIRE( record->is_slp_output(2) );
+    REQUIRE( ! record->is_slp_output(3) );
+    REQUIRE( validator.find(graph_txid(9)) == nullptr );
+
+    // txdata of these is not a real transaction, so there is nothing to parse
+    gs::transaction hydrated;
+    REQUIRE( ! validator.get(mint.txid, hydrated) );
+    REQUIRE( ! validator.get(graph_txid(9), hydrated) );
+    const std::uint8_t* txdata = nullptr;
+    std::size_t txdata_size = 0;
+    REQUIRE( validator.txdata(mint.txid, txdata, txdata_size) );
+    REQUIRE( txdata_size == 2 );
+    REQUIRE( txdata[0] == 2 );
+
+    // spends of the baton and the minted amount are slp inputs, change is not
+    gs::transaction spender;
+    spender.inputs = { gs::outpoint(graph_txid(2), 1), gs::outpoint(graph_txid(2), 2), gs::outpoint(graph_txid(2), 0), gs::outpoint(graph_txid(9), 1) };
+    REQUIRE( spender.slp_inputs(validator).size() == 2 );
+
+    REQUIRE( validator.mint_batons.size() == 3 );
+    REQUIRE( validator.mint_batons.count(gs::outpoint(graph_txid(3), 2)) );
+
+    // a mint whose baton left the validator has nothing to spend
+    REQUIRE( validator.remove_tx(remint.txid) );
+    REQUIRE( validator.remove_tx(mint.txid) );
+    REQUIRE( validator.mint_batons.size() == 1 );
+    REQUIRE( ! validator.validate(remint) );
+}
+
+TEST_CASE( "slp_validator_add_txs", "[single-file]" ) {
+    // token 1: genesis 1 -baton-> mint 2 -> send 3, send 4 spends more than it has
+    // token 5: group genesis 5 -> child genesis 6 (token 6) -> send 7
+    std::vector<gs::transaction> txs = {
+        make_slp_tx(1, gs::slp_transaction(gs::slp_transaction_genesis("T", "T", "", "", 0, true, 2, 100)), {}),
+        make_slp_tx(5, gs::slp_transaction(gs::slp_transaction_genesis("G", "G", "", "", 0, false, 0, 10)), {}),
+        make_slp_tx(2, gs::slp_transaction(gs::slp_transaction_mint(true, 2, 10)), { gs::outpoint(graph_txid(1), 2) }),
+        make_slp_tx(6, gs::slp_transaction(gs::slp_transaction_genesis("C", "C", "", "", 0, false, 0, 1)), { gs::outpoint(graph_txid(5), 1) }),
+        make_slp_tx(3, gs::slp_transaction(gs::slp_transaction_send({ 110 })), { gs::outpoint(graph_txid(1), 1), gs::outpoint(graph_txid(2), 1) }),
+        make_slp_tx(7, gs::slp_transaction(gs::slp_transaction_send({ 1 })), { gs::outpoint(graph_txid(6), 1) }),
+        make_slp_tx(4, gs::slp_transaction(gs::slp_transaction_send({ 1000 })), { gs::outpoint(graph_txid(3), 1) }),
+    };
+    txs[1].slp.tokenid.v[0] = 5;
+    txs[1].slp.token_type = 0x81;
+    txs[3].slp.tokenid.v[0] = 6;
+    txs[3].slp.token_type = 0x41;
+    txs[5].slp.tokenid.v[0] = 6;
+    txs[5].slp.token_type = 0x41;
+
+    std::vector<const gs::transaction*> ptrs;
+    for (const auto & tx : txs) {
+        ptrs.push_back(&tx);
+    }
+
+    gs::slp_validator serial;
+    std::vector<bool> expected;
+    for (const auto & tx : txs) {
+        expected.push_back(serial.add_tx(tx, false));
+    }
+    REQUIRE( expected == std::vector<bool>({ true, true, true, true, true, true, false }) );
+
+    // too few tokens to start workers by default, 0 forces them
+    for (const std::size_t min_parallel_partitions : { std::size_t(0), gs::slp_validator().min_parallel_partitions }) {
+        for (const unsigned threads : { 1u, 2u, 8u }) {
+            gs::slp_validator validator;
+            validator.min_parallel_partitions = min_parallel_partitions;
+            REQUIRE( validator.add_txs(ptrs, false, threads) == expected );
+            REQUIRE( validator.valid == serial.valid );
+            REQUIRE( validator.invalid.size() == 1 );
+            REQUIRE( validator.invalid.at(graph_txid(4)) == gs::slp_invalid_reason::send_inputs );
+            REQUIRE( validator.mint_batons.size() == 2 );
+
+            // known transactions are not new, as with add_tx
+            REQUIRE( validator.add_txs(ptrs, false, threads) == std::vector<bool>(txs.size(), false) );
+            REQUIRE( validator.valid == serial.valid );
+        }
+    }
+}
+
+TEST_CASE( "slp_validation_stats", "[single-file]" ) {
+    SECTION ("\thistogram buckets") {
+        gs::slp_validation_histogram histogram;
+        for (const std::uint64_t v : { 0, 1, 2, 3, 4, 1000 }) {
+            histogram.add(v);
+        }
+        REQUIRE( histogram.buckets[0] == 1 );
+        REQUIRE( histogram.buckets[1] == 1 );
+        REQUIRE( histogram.buckets[2] == 2 );
+        REQUIRE( histogram.buckets[3] == 1 );
+        REQUIRE( histogram.buckets[10] == 1 );
+        REQUIRE( histogram.count == 6 );
+        REQUIRE( histogram.sum == 1010 );
+        REQUIRE( histogram.max == 1000 );
+    }
+
+    SECTION ("\tslowest are kept in order") {
+        const std::size_t num_slowest = gs::slp_validation_stats::num_slowest;
+        gs::slp_validation_stats stats;
+        for (unsigned i=0; i<num_slowest * 2; ++i) {
+            gs::slp_validation_cost cost;
+            cost.nanoseconds = (i * 7) % 32;
+            stats.record(graph_txid(i), gs::tokenid(), cost);
+        }
+
+        const gs::slp_validation_report report = stats.report();
+        REQUIRE( report.nanoseconds.count == num_slowest * 2 );
+        REQUIRE( report.slowest.size() == num_slowest );
+        REQUIRE( report.slowest.front().cost.nanoseconds == 31 );
+        REQUIRE( report.slowest.back().cost.nanoseconds == 16 );
+        for (std::size_t i=1; i<report.slowest.size(); ++i) {
+            REQUIRE( report.slowest[i-1].cost.nanoseconds >= report.slowest[i].cost.nanoseconds );
+        }
+    }
+
+    SECTION ("\tvalidator counts inputs and lookups") {
+        // genesis 1 -baton-> mint 2 -> send 3
+        gs::slp_validator validator;
+        REQUIRE( validator.add_tx(make_slp_tx(1, gs::slp_transaction(gs::slp_transaction_genesis("T", "T", "", "", 0, true, 2, 100)), {}), false) );
+        REQUIRE( validator.add_tx(make_slp_tx(2, gs::slp_transaction(gs::slp_transaction_mint(true, 2, 10)), { gs::outpoint(graph_txid(1), 2) }), false) );
+        REQUIRE( validator.add_tx(make_slp_tx(3, gs::slp_transaction(gs::slp_transaction_send({ 60, 50 })), { gs::outpoint(graph_txid(1), 1), gs::outpoint(graph_txid(2), 1) }), false) );
+
+        const gs::slp_validation_report report = validator.stats.report();
+        REQUIRE( report.inputs.count == 3 );
+        REQUIRE( report.inputs.sum == 0 + 1 + 2 );
+        REQUIRE( report.inputs.max == 2 );
+        // each validation checks its own txid, then the mint finds its baton
+        // and the send checks and finds both of its inputs
+        REQUIRE( report.lookups.sum == 1 + 2 + 5 );
+        REQUIRE( report.slowest.size() == 3 );
+    }
+}
+
+TEST_CASE( "slp_validator_snapshot", "[single-file]" ) {
+    const std::string path = "slp_validator_test.snapshot";
+
+    // genesis 1 -baton-> mint 2 -> send 3, send 4 spends more than it has
+    gs::slp_validator validator;
+    REQUIRE( validator.add_tx(make_slp_tx(1, gs::slp_transaction(gs::slp_transaction_genesis("T", "T", "", "", 0, true, 2, 100)), {}), false) );
+    REQUIRE( validator.add_tx(make_slp_tx(2, gs::slp_transaction(gs::slp_transaction_mint(true, 2, 10)), { gs::outpoint(graph_txid(1), 2) }), false) );
+    REQUIRE( validator.add_tx(make_slp_tx(3, gs::slp_transaction(gs::slp_transaction_send({ 60, 50 })), { gs::outpoint(graph_txid(1), 1), gs::outpoint(graph_txid(2), 1) }), false) );
+    REQUIRE( ! validator.add_tx(make_slp_tx(4, gs::slp_transaction(gs::slp_transaction_send({ 1000 })), { gs::outpoint(graph_txid(3), 1) }), false) );
+    // send 6 is still in the mempool when the snapshot is taken
+    const gs::transaction mempool_tx = make_slp_tx(6, gs::slp_transaction(gs::slp_transaction_send({ 50 })), { gs::outpoint(graph_txid(3), 2) });
+    REQUIRE( validator.add_tx(mempool_tx, false) );
+
+    gs::slp_validator_snapshot saved;
+    saved.height = 12;
+    saved.block_hash.v[0] = 0xcd;
+    REQUIRE( saved.save(path, validator, [](const gs::txid& txid) { return txid != graph_txid(6); }) );
+
+    SECTION ("\tround trip") {
+        gs::slp_validator loaded_validator;
+        gs::slp_validator_snapshot loaded;
+        REQUIRE( loaded.load(path, loaded_validator) );
+        REQUIRE( loaded.height == 12 );
+        REQUIRE( loaded.block_hash == saved.block_hash );
+        REQUIRE( loaded_validator.valid.size() == 3 );
+        REQUIRE( loaded_validator.has_valid(graph_txid(3)) );
+        REQUIRE( loaded_validator.records.size() == 4 );
+        REQUIRE( loaded_validator.mint_batons.size() == 2 );
+        REQUIRE( ! loaded_validator.has_valid(graph_txid(4)) );
+
+        const gs::slp_record* record = loaded_validator.find(graph_txid(3));
+        REQUIRE( record != nullptr );
+        REQUIRE( record->type == gs::slp_transaction_type::send );
+        REQUIRE( record->inputs.size() == 2 );
+        REQUIRE( record->inputs[1] == gs::outpoint(graph_txid(2), 1) );
+        REQUIRE( record->amounts == std::vector<std::uint64_t>({ 60, 50 }) );
+
+        const std::uint8_t* txdata = nullptr;
+        std::size_t txdata_size = 0;
+        REQUIRE( loaded_validator.txdata(graph_txid(3), txdata, txdata_size) );
+        REQUIRE( txdata_size == 3 );
+        REQUIRE( txdata[0] == 3 );
+
+        // the restored baton of mint 2 can be spent
+        REQUIRE( loaded_validator.add_tx(make_slp_tx(5, gs::slp_transaction(gs::slp_transaction_mint(false, 0, 10)), { gs::outpoint(graph_txid(2), 2) }), false) );
+    }
+
+    SECTION ("\tmempool transactions are new once confirmed") {
+        gs::slp_validator loaded_validator;
+        gs::slp_validator_snapshot loaded;
+        REQUIRE( loaded.load(path, loaded_validator) );
+        REQUIRE( ! loaded_validator.has(graph_txid(6)) );
+        REQUIRE( ! loaded_validator.has_valid(graph_txid(6)) );
+
+        // the block confirming it validates it again instead of skipping it as known
+        const std::vector<const gs::transaction*> block({ &mempool_tx });
+        REQUIRE( loaded_validator.add_txs(block, false, 1) == std::vector<bool>({ true }) );
+        REQUIRE( loaded_validator.has_valid(graph_txid(6)) );
+    }
+
+    SECTION ("\ttxdata is served from the image") {
+        gs::tx_store store;
+        gs::slp_validator loaded_validator(store);
+        gs::slp_validator_snapshot loaded;
+        REQUIRE( loaded.load(path, loaded_validator) );
+
+        // the mapping outlives the file
+        std::remove(path.c_str());
+
+        const std::uint8_t* txdata = nullptr;
+        std::size_t txdata_size = 0;
+        REQUIRE( loaded_validator.txdata(graph_txid(3), txdata, txdata_size) );
+        REQUIRE( txdata_size == 3 );
+        REQUIRE( txdata[0] == 3 );
+        REQUIRE( store.size() == 4 );
+    }
+
+    SECTION ("\tcorrupt images are rejected") {
+        {
+            std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+            f.seekp(100);
+            f.put(0x7f);
+        }
+
+        gs::slp_validator loaded_validator;
+        gs::slp_validator_snapshot loaded;
+        REQUIRE( ! loaded.load(path, loaded_validator) );
+        REQUIRE( loaded_validator.records.empty() );
+        REQUIRE( loaded_validator.valid.empty() );
+    }
+
+    std::remove(path.c_str());
+}
 
 TEST_CASE( "script_tests", "[single-file]" ) {
 	std::ifstream test_data_stream("./slp-unit-test-data/src/slp-unit-test-data/script_tests.json");